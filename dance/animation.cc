@@ -243,10 +243,9 @@ void Animator::onMeterDrop(display::MouseKeys mKeys, display::point p, display::
 }
 
 void Meter::reset(int index) {
-	_timeIndex = 0;
-	for (int i = 0; i < index && i < _stageDurations.size(); i++)
-		_timeIndex += _stageDurations[i];
-	_timeIndex *= _ticksPerBeat;
+	if (index > _stageDurations.size())
+		index = _stageDurations.size();
+	_timeIndex = _stageStarts[index] * _ticksPerBeat;
 	if (_editor)
 		_editor->select(index);
 	_picture->setIndex(index);
@@ -256,14 +255,8 @@ void Meter::reset(int index) {
 bool Meter::tick() {
 	invalidate();
 	_timeIndex++;
-	int cumulative = 0;
-	int i;
-	for (i = 0; i < _stageDurations.size(); i++) {
-		int dur = _stageDurations[i] * _ticksPerBeat;
-		if (cumulative + dur > _timeIndex)
-			break;
-		cumulative += dur;
-	}
+	int cumulative;
+	int i = stageAt(_timeIndex, &cumulative);
 	if (_editor)
 		_editor->select(i);
 	if (cumulative == _timeIndex)
@@ -272,8 +265,25 @@ bool Meter::tick() {
 	return _timeIndex < _duration * _ticksPerBeat;
 }
 
+int Meter::stageAt(int timeIndex, int* stageStart) const {
+	// The first stage that ends after timeIndex, so empty stages are passed over.
+	int lo = 0;
+	int hi = _stageDurations.size();
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (_stageStarts[mid + 1] * _ticksPerBeat > timeIndex)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	*stageStart = _stageStarts[lo] * _ticksPerBeat;
+	return lo;
+}
+
 void Meter::setup(Sequence *sequence) {
 	_stageDurations.clear();
+	_stageStarts.clear();
+	_stageStarts.push_back(0);
 	_duration = 0;
 	if (sequence) {
 		const vector<const Stage*>& stages = sequence->stages();
@@ -284,6 +294,7 @@ void Meter::setup(Sequence *sequence) {
 			else
 				_stageDurations.push_back(0);
 			_duration += _stageDurations[i];
+			_stageStarts.push_back(_duration);
 		}
 	}
 }
@@ -619,7 +630,7 @@ void Picture::paint(display::Device* device) {
 			if (stage) {
 				int dancerCount = stage->dancerCount();
 				for (int i = 0; i < dancerCount; i++)
-					_painted[i] = paintMotion(device, i, stage->motion(i), _partial);
+					_painted[i] = paintMotion(device, i, stage->activeMotion(i, _partial), _partial);
 			}
 			for (int i = 0; i < MAX_DANCERS; i++)
 				if (!_painted[i]) {
@@ -641,45 +652,12 @@ void Picture::paint(display::Device* device) {
 }
 
 bool Picture::paintMotion(display::Device* device, int dancerIndex, const Motion* m, double partial) {
-	double x = 0;
-	double y = 0;
-	double noseAngle = 0;
-
-	bool painted = false;
-	for (;;) {
-		m = combineMotion(m, partial, &x, &y, &noseAngle);
-		if (m) {
-			painted = true;
-			m = m->also();
-			if (m == null)
-				break;
-		} else
-			break;
-	}
-
-	if (painted)
-		drawDancer(device, Gender(dancerIndex & 1), (dancerIndex / 2) + 1, x, y, noseAngle, NO_NOSE);
-	return painted;
-}
+	double x, y, noseAngle;
 
-const Motion* Picture::combineMotion(const Motion* m, double partial, double* x, double* y, double* noseAngle) {
-	for (; m; m = m->previous()) {
-		if (m->startAt() >= partial)
-			continue;
-		double fraction;
-		if (m->endAt() > partial)
-			fraction = (partial - m->startAt()) / m->duration();
-		else
-			fraction = 1;
-		double localX, localY;
-		m->location(fraction, &localX, &localY);
-
-		*noseAngle += m->startNose() + fraction * m->noseMotion();
-		*x += localX;
-		*y += localY;
-		return m;
-	}
-	return null;
+	if (!locateMotion(m, partial, &x, &y, &noseAngle))
+		return false;
+	drawDancer(device, Gender(dancerIndex & 1), (dancerIndex / 2) + 1, x, y, noseAngle, NO_NOSE);
+	return true;
 }
 
 void Picture::paintFinishedMotion(display::Device* device, int dancerIndex, const Motion* m) {
@@ -700,34 +678,6 @@ double Picture::getBaseAngle() const {
 		return rotationAngle(_start->rotation());
 }
 
-void Picture::facingToAngles(Facing facing, double* noseAngle, double* secondNoseAngle) {
-	*secondNoseAngle = NO_NOSE;
-	switch (facing) {
-	case	HEAD_FACING:
-		*secondNoseAngle = -PI / 2;
-	case	BACK_FACING:
-		*noseAngle = PI / 2;
-		break;
-
-	case	SIDE_FACING:
-		*secondNoseAngle = PI;
-	case	RIGHT_FACING:
-		*noseAngle = 0;
-		break;
-
-	case	LEFT_FACING:
-		*noseAngle = PI;
-		break;
-
-	case	FRONT_FACING:
-		*noseAngle = -PI / 2;
-		break;
-
-	case	ANY_FACING:
-		*noseAngle = NO_NOSE;
-	}
-}
-
 void Picture::drawDancer(display::Device* device, double baseAngle, const Dancer* dancer) {
 	float x = dancer->x;
 	float y = dancer->y;
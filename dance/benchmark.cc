@@ -0,0 +1,720 @@
+#include "../common/platform.h"
+#include "benchmark.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../common/file_system.h"
+#include "../common/timing.h"
+#include "call.h"
+#include "motion.h"
+
+namespace dance {
+
+static double elapsedSince(clock_t start);
+static double percentile(const vector<double>& times, double fraction);
+static int compareTimes(const void* a, const void* b);
+static void writeJsonString(FILE* out, const string& s);
+static const Group* facingLinesOfSix(Context* context);
+
+static const char* phaseNames[] = {
+	"load",
+	"compile",
+	"read",
+	"parse",
+	"run",
+	"motions",
+	"sampling",
+	"total",
+};
+
+static const int layoutSizes[] = { 8, 12 };
+
+static const char* parsedCall = "square thru";
+
+static const char* concepts[][2] = {
+	{ "left ", "" },
+	{ "", " twice" },
+	{ "as couples ", "" },
+	{ "1/2 ", "" },
+};
+
+static const char* plainCalls[] = {
+	"face in",
+	"pass thru",
+	"star thru",
+	"square thru",
+	"right and left thru",
+	"swing thru",
+	"circulate",
+	"heads square thru",
+	"heads star thru",
+	"dosado to a wave",
+};
+
+static const Transform* transforms[] = {
+	&Transform::identity,
+	&Transform::rotate90,
+	&Transform::rotate180,
+	&Transform::rotate270,
+	&Transform::mirror,
+};
+
+Benchmark::Benchmark(const string& grammarFile, int runs, int scale) {
+	_grammarFile = grammarFile;
+	_runs = runs > 0 ? runs : 1;
+	_scale = scale > 0 ? scale : 1;
+	_sequences = 0;
+	_calls = 0;
+	_samples = 0;
+	_checksum = 0;
+}
+
+void Benchmark::addFile(const string& filename) {
+	_files.push_back(filename);
+}
+
+bool Benchmark::run() {
+	timing::Timer t("Benchmark::run");
+	for (int i = 0; i < BENCHMARK_WARMUP_RUNS; i++)
+		if (!runOnce(false))
+			return false;
+	for (int i = 0; i < _runs; i++)
+		if (!runOnce(true))
+			return false;
+	return true;
+}
+
+bool Benchmark::runOnce(bool timed) {
+	double elapsed[BENCH_PHASES];
+	for (int i = 0; i < BENCH_PHASES; i++)
+		elapsed[i] = 0;
+	_sequences = 0;
+	_calls = 0;
+	_samples = 0;
+	_checksum = 0;
+	clock_t start = clock();
+	Grammar* grammar = new Grammar();
+	bool result = grammar->read(_grammarFile);
+	elapsed[BENCH_LOAD] = elapsedSince(start);
+	if (result) {
+		clock_t compile = clock();
+		grammar->compileStateMachines();
+		elapsed[BENCH_COMPILE] = elapsedSince(compile);
+		for (int i = 0; result && i < _files.size(); i++)
+			result = runFile(_files[i], grammar, elapsed);
+	} else
+		printf("Could not read %s\n", _grammarFile.c_str());
+	delete grammar;
+	elapsed[BENCH_TOTAL] = elapsedSince(start);
+	if (result && timed)
+		for (int i = 0; i < BENCH_PHASES; i++)
+			_times[i].push_back(elapsed[i]);
+	return result;
+}
+
+bool Benchmark::runFile(const string& filename, const Grammar* grammar, double* elapsed) {
+	clock_t start = clock();
+	Dance* d = new Dance(fileSystem::basename(filename), filename);
+
+	// The stage cache would time its own sidecar file and hashing as part of the
+	// run, and a warm cache would skip work that earlier runs did.
+
+	d->disableStageCache();
+	if (!d->read()) {
+		printf("Could not read %s\n", filename.c_str());
+		delete d;
+		return false;
+	}
+	int original = d->sequences().size();
+	for (int k = 1; k < _scale; k++)
+		for (int i = 0; i < original; i++) {
+			const Sequence* seq = d->sequences()[i];
+			Sequence* copy = d->newSequence();
+			copy->setLevel(seq->level());
+			for (int j = 0; j < seq->text().size(); j++)
+				copy->append(seq->text()[j]);
+		}
+	elapsed[BENCH_READ] += elapsedSince(start);
+	const vector<Sequence*>& sequences = d->sequences();
+	_sequences += sequences.size();
+
+	start = clock();
+	for (int i = 0; i < sequences.size(); i++) {
+		Sequence* seq = sequences[i];
+		Context context(seq, grammar);
+		Stage* parses = new Stage(seq, Group::home, grammar->termPool());
+		context.startStage(parses);
+		const vector<string>& text = seq->text();
+		for (int j = 0; j < text.size(); j++)
+			grammar->parse(null, text[j], false, null, &context, null);
+		context.endStage();
+		delete parses;
+		_calls += text.size();
+	}
+	elapsed[BENCH_PARSE] += elapsedSince(start);
+
+	start = clock();
+	d->runAll(true, grammar);
+	elapsed[BENCH_RUN] += elapsedSince(start);
+
+	// Each stage is performed again, untimed, so that collecting its motions can be
+	// timed on its own.
+
+	vector<Stage*> replays;
+	for (int i = 0; i < sequences.size(); i++) {
+		Sequence* seq = sequences[i];
+		const vector<const Stage*>& stages = seq->stages();
+		for (int j = 0; j < stages.size(); j++) {
+			if (stages[j]->failed() || stages[j]->call() == null)
+				continue;
+			Context context(seq, grammar);
+			Stage* replay = new Stage(seq, stages[j]->start(), grammar->termPool());
+			context.startStage(replay);
+			replay->setCall(stages[j]->call());
+			replay->perform(null, &context, TILE_ALL);
+			replay->breathe(&context);
+			context.endStage();
+			if (replay->failed())
+				delete replay;
+			else
+				replays.push_back(replay);
+		}
+	}
+	start = clock();
+	for (int i = 0; i < replays.size(); i++)
+		replays[i]->collectMotions();
+	elapsed[BENCH_MOTIONS] += elapsedSince(start);
+
+	start = clock();
+	for (int i = 0; i < replays.size(); i++) {
+		const Stage* stage = replays[i];
+		int samples = stage->duration() * BENCHMARK_SAMPLES_PER_BEAT;
+		for (int k = 1; k <= samples; k++) {
+			double partial = double(k) / BENCHMARK_SAMPLES_PER_BEAT;
+			for (int j = 0; j < stage->dancerCount(); j++) {
+				double x, y, nose;
+
+				if (locateMotion(stage->activeMotion(j, partial), partial, &x, &y, &nose))
+					_checksum += x + y;
+				_samples++;
+			}
+		}
+	}
+	elapsed[BENCH_SAMPLING] += elapsedSince(start);
+
+	replays.deleteAll();
+	for (int i = 0; i < sequences.size(); i++)
+		sequences[i]->clearStages();
+	delete d;
+	return true;
+}
+
+int Benchmark::compare(const string& baselineFile) {
+	FILE* fp = fopen(baselineFile.c_str(), "r");
+	if (fp == null)
+		return -1;
+	_baselineFile = baselineFile;
+	_regressions.clear();
+	char line[512];
+	while (fgets(line, sizeof line, fp)) {
+		char name[64];
+		double baseline;
+
+		if (sscanf(line, " \"%63[^\"]\": { \"median\": %lf", name, &baseline) != 2)
+			continue;
+		for (int i = 0; i < BENCH_PHASES; i++) {
+			if (strcmp(name, phaseNames[i]) != 0)
+				continue;
+			double median = statistic(BenchmarkPhase(i), 0.5);
+			if (median > baseline * (1 + BENCHMARK_TOLERANCE) &&
+				median - baseline > BENCHMARK_MIN_DELTA) {
+				string s;
+
+				s.printf("%s: median %.1f ms, baseline %.1f ms (%+.0f%%)", name, median, baseline, 100 * (median - baseline) / baseline);
+				_regressions.push_back(s);
+			}
+		}
+	}
+	fclose(fp);
+	return _regressions.size();
+}
+
+void Benchmark::write(FILE* out) const {
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"version\": ");
+	writeJsonString(out, VERSION);
+	fprintf(out, ",\n\t\"grammar\": ");
+	writeJsonString(out, _grammarFile);
+	fprintf(out, ",\n\t\"files\": [");
+	for (int i = 0; i < _files.size(); i++) {
+		fprintf(out, i ? ", " : "");
+		writeJsonString(out, _files[i]);
+	}
+	fprintf(out, "],\n");
+	fprintf(out, "\t\"warmup\": %d,\n", BENCHMARK_WARMUP_RUNS);
+	fprintf(out, "\t\"runs\": %d,\n", _times[0].size());
+	fprintf(out, "\t\"scale\": %d,\n", _scale);
+	fprintf(out, "\t\"sequences\": %d,\n", _sequences);
+	fprintf(out, "\t\"calls\": %d,\n", _calls);
+	fprintf(out, "\t\"samples\": %d,\n", _samples);
+	fprintf(out, "\t\"checksum\": %.3f,\n", _checksum);
+	fprintf(out, "\t\"phases\": {\n");
+
+	// Each phase is on a line of its own, which is how compare reads them back.
+
+	for (int i = 0; i < BENCH_PHASES; i++)
+		fprintf(out, "\t\t\"%s\": { \"median\": %.3f, \"p10\": %.3f, \"p90\": %.3f, \"min\": %.3f, \"max\": %.3f }%s\n",
+				phaseNames[i], 
+				statistic(BenchmarkPhase(i), 0.5), 
+				statistic(BenchmarkPhase(i), 0.1), 
+				statistic(BenchmarkPhase(i), 0.9),
+				statistic(BenchmarkPhase(i), 0), 
+				statistic(BenchmarkPhase(i), 1),
+				i < BENCH_PHASES - 1 ? "," : "");
+	fprintf(out, "\t}");
+	if (_baselineFile.size()) {
+		fprintf(out, ",\n\t\"baseline\": ");
+		writeJsonString(out, _baselineFile);
+		fprintf(out, ",\n\t\"regressions\": [");
+		for (int i = 0; i < _regressions.size(); i++) {
+			fprintf(out, i ? ",\n\t\t" : "\n\t\t");
+			writeJsonString(out, _regressions[i]);
+		}
+		fprintf(out, _regressions.size() ? "\n\t]" : "]");
+	}
+	fprintf(out, "\n}\n");
+}
+double Benchmark::statistic(BenchmarkPhase phase, double fraction) const {
+	return percentile(_times[phase], fraction);
+}
+
+MicroBenchmark::MicroBenchmark(const Grammar* grammar, int runs) : _random(MICRO_BENCHMARK_SEED) {
+	_grammar = grammar;
+	_runs = runs > 0 ? runs : 1;
+	_sequence = null;
+	_storage = null;
+	_samples = 0;
+	_checksum = 0;
+}
+
+MicroBenchmark::~MicroBenchmark() {
+	_replays.deleteAll();
+	delete _storage;
+	delete _sequence;
+	_subsystems.deleteAll();
+}
+
+void MicroBenchmark::run() {
+	timing::Timer t("MicroBenchmark::run");
+	prepare();
+	for (int i = 0; i < BENCHMARK_WARMUP_RUNS; i++)
+		runOnce(false);
+	for (int i = 0; i < _runs; i++)
+		runOnce(true);
+}
+/*
+ *	prepare
+ *
+ *	Generates the inputs, untimed, and names the subsystems in the order that runOnce
+ *	times them.
+ */
+void MicroBenchmark::prepare() {
+	_sequence = new Sequence(null);
+	_storage = new Stage(_sequence, Group::home, _grammar->termPool());
+	Context context(_sequence, _grammar);
+	context.startStage(_storage);
+	for (int d = 0; d <= MICRO_BENCHMARK_MAX_DEPTH; d++) {
+		string text = parsedCall;
+		for (int k = 0; k < d; k++) {
+			const char** concept = concepts[k % dimOf(concepts)];
+			text = string(concept[0]) + text + string(concept[1]);
+		}
+		_texts[d] = text;
+		if (!_grammar->tokenizeCall(text, &context, &_tokens[d]))
+			printf("Could not tokenize '%s'\n", text.c_str());
+		addSubsystem(string("tokenize/") + string(d), MICRO_BENCHMARK_PARSES);
+	}
+	for (int d = 0; d <= MICRO_BENCHMARK_MAX_DEPTH; d++)
+		addSubsystem(string("stateMachine/") + string(d), MICRO_BENCHMARK_PARSES);
+	const vector<Formation*>& formations = _grammar->formations();
+	for (int s = 0; s < dimOf(layoutSizes); s++) {
+		for (int i = 0; i < MICRO_BENCHMARK_LAYOUTS; i++)
+			_layouts[s].push_back(randomLayout(layoutSizes[s], &context));
+		addSubsystem(string("matchSome/") + string(layoutSizes[s]),
+					 double(MICRO_BENCHMARK_MATCH_PASSES) * formations.size() * _layouts[s].size());
+	}
+
+	// Each plain call is performed from the standard setup, and again from every
+	// position one plain call from it.  Only those that work are timed.
+
+	for (int s = 0; s < dimOf(layoutSizes); s++) {
+		vector<const Group*> starts;
+		starts.push_back(layoutSizes[s] == 8 ? Group::home : facingLinesOfSix(&context));
+		for (int i = 0; i < starts.size(); i++)
+			for (int c = 0; c < dimOf(plainCalls); c++) {
+				const Anything* call = _grammar->parse(starts[i], plainCalls[c], false, null, &context, null);
+				if (call == null)
+					continue;
+				Stage* stage = performOnce(starts[i], call);
+				if (stage == null)
+					continue;
+				_starts[s].push_back(starts[i]);
+				_calls[s].push_back(call);
+				stage->collectMotions();
+				_replays.push_back(stage);
+				if (i == 0)
+					starts.push_back(stage->final());
+			}
+		double performs = double(MICRO_BENCHMARK_PERFORM_PASSES) * _calls[s].size();
+		addSubsystem(string("perform/") + string(layoutSizes[s]), performs);
+		addSubsystem(string("breathe/") + string(layoutSizes[s]), performs);
+	}
+	context.endStage();
+	addSubsystem("transform", double(MICRO_BENCHMARK_TRANSFORM_PASSES) * dimOf(transforms) *
+							  MICRO_BENCHMARK_COLUMNS * MICRO_BENCHMARK_ROWS * 4);
+	for (int i = 0; i < _replays.size(); i++)
+		_samples += _replays[i]->duration() * BENCHMARK_SAMPLES_PER_BEAT * _replays[i]->dancerCount();
+	addSubsystem("sampling", double(MICRO_BENCHMARK_SAMPLING_PASSES) * _samples);
+}
+
+void MicroBenchmark::runOnce(bool timed) {
+	vector<double> elapsed;
+	for (int d = 0; d <= MICRO_BENCHMARK_MAX_DEPTH; d++)
+		elapsed.push_back(timeTokenize(d));
+	for (int d = 0; d <= MICRO_BENCHMARK_MAX_DEPTH; d++)
+		elapsed.push_back(timeStateMachine(d));
+	for (int s = 0; s < dimOf(layoutSizes); s++)
+		elapsed.push_back(timeMatching(_layouts[s]));
+	for (int s = 0; s < dimOf(layoutSizes); s++) {
+		double performing, breathing;
+
+		timePerforming(s, &performing, &breathing);
+		elapsed.push_back(performing);
+		elapsed.push_back(breathing);
+	}
+	elapsed.push_back(timeTransforms());
+	elapsed.push_back(timeSampling());
+	if (timed)
+		for (int i = 0; i < _subsystems.size(); i++)
+			_subsystems[i]->times.push_back(elapsed[i]);
+}
+
+void MicroBenchmark::addSubsystem(const string& name, double operations) {
+	MicroSubsystem* s = new MicroSubsystem;
+	s->name = name;
+	s->operations = operations;
+	_subsystems.push_back(s);
+}
+
+const Group* MicroBenchmark::randomLayout(int dancers, Context* context) {
+	Group* g = context->stage()->newGroup(GRID);
+	unsigned taken = 0;
+	for (int i = 0; i < dancers; i++) {
+		int spot;
+		do
+			spot = _random.next(MICRO_BENCHMARK_COLUMNS * MICRO_BENCHMARK_ROWS);
+		while (taken & (1 << spot));
+		taken |= 1 << spot;
+		int x = 2 * (spot % MICRO_BENCHMARK_COLUMNS) - MICRO_BENCHMARK_COLUMNS + 1;
+		int y = 2 * (spot / MICRO_BENCHMARK_COLUMNS) - MICRO_BENCHMARK_ROWS + 1;
+		g->insert(new Dancer(x, y, Facing(_random.next(4)), Gender(i % 2), i / 2 + 1));
+	}
+	g->done();
+	return g;
+}
+/*
+ *	performOnce
+ *
+ *	Returns the stage for the call performed and breathed from start, or null if the
+ *	call fails there.
+ */
+Stage* MicroBenchmark::performOnce(const Group* start, const Anything* call) {
+	Context context(_sequence, _grammar);
+	Stage* stage = new Stage(_sequence, start, _grammar->termPool());
+	context.startStage(stage);
+	stage->setCall(call);
+	stage->perform(null, &context, TILE_ALL);
+	stage->breathe(&context);
+	context.endStage();
+	if (stage->failed() || stage->final() == null) {
+		delete stage;
+		return null;
+	}
+	return stage;
+}
+
+double MicroBenchmark::timeTokenize(int depth) {
+	Stage* scratch = new Stage(_sequence, Group::home, _grammar->termPool());
+	Context context(_sequence, _grammar);
+	context.startStage(scratch);
+	clock_t start = clock();
+	for (int i = 0; i < MICRO_BENCHMARK_PARSES; i++) {
+		vector<Token> tokens;
+		_grammar->tokenizeCall(_texts[depth], &context, &tokens);
+		_checksum += tokens.size();
+	}
+	double elapsed = elapsedSince(start);
+	context.endStage();
+	delete scratch;
+	return elapsed;
+}
+
+double MicroBenchmark::timeStateMachine(int depth) {
+	Stage* scratch = new Stage(_sequence, Group::home, _grammar->termPool());
+	Context context(_sequence, _grammar);
+	context.startStage(scratch);
+	clock_t start = clock();
+	for (int i = 0; i < MICRO_BENCHMARK_PARSES; i++) {
+		int matched = 0;
+		_grammar->matchAnycall(false, _tokens[depth], 0, true, &matched, null, &context);
+		_checksum += matched;
+	}
+	double elapsed = elapsedSince(start);
+	context.endStage();
+	delete scratch;
+	return elapsed;
+}
+
+double MicroBenchmark::timeMatching(const vector<const Group*>& layouts) {
+	const vector<Formation*>& formations = _grammar->formations();
+	clock_t start = clock();
+	for (int k = 0; k < MICRO_BENCHMARK_MATCH_PASSES; k++)
+		for (int i = 0; i < formations.size(); i++)
+			for (int j = 0; j < layouts.size(); j++)
+				_checksum += formations[i]->matchSome(layouts[j], 0, null);
+	return elapsedSince(start);
+}
+/*
+ *	timePerforming
+ *
+ *	Performs every call from its start, then breathes the results, timing each half
+ *	across all the stages at once, since a single call takes less than a clock tick.
+ *	The breathing solutions are cleared first, so that every pass does the same work.
+ */
+void MicroBenchmark::timePerforming(int setup, double* performing, double* breathing) {
+	*performing = 0;
+	*breathing = 0;
+	const vector<const Group*>& starts = _starts[setup];
+	vector<Stage*> stages;
+	for (int k = 0; k < MICRO_BENCHMARK_PERFORM_PASSES; k++) {
+		for (int i = 0; i < starts.size(); i++) {
+			Stage* stage = new Stage(_sequence, starts[i], _grammar->termPool());
+			stage->setCall(_calls[setup][i]);
+			stages.push_back(stage);
+		}
+		_grammar->breathingSolutions()->clear();
+		clock_t start = clock();
+		for (int i = 0; i < stages.size(); i++) {
+			Context context(_sequence, _grammar);
+			context.startStage(stages[i]);
+			stages[i]->perform(null, &context, TILE_ALL);
+			context.endStage();
+		}
+		*performing += elapsedSince(start);
+		_grammar->breathingSolutions()->clear();
+		start = clock();
+		for (int i = 0; i < stages.size(); i++) {
+			if (stages[i]->failed())
+				continue;
+			Context context(_sequence, _grammar);
+			context.startStage(stages[i]);
+			stages[i]->breathe(&context);
+			context.endStage();
+		}
+		*breathing += elapsedSince(start);
+		stages.deleteAll();
+		stages.clear();
+	}
+}
+
+double MicroBenchmark::timeTransforms() {
+	clock_t start = clock();
+	for (int k = 0; k < MICRO_BENCHMARK_TRANSFORM_PASSES; k++)
+		for (int t = 0; t < dimOf(transforms); t++)
+			for (int spot = 0; spot < MICRO_BENCHMARK_COLUMNS * MICRO_BENCHMARK_ROWS; spot++)
+				for (int f = RIGHT_FACING; f <= FRONT_FACING; f++) {
+					int x = 2 * (spot % MICRO_BENCHMARK_COLUMNS) - MICRO_BENCHMARK_COLUMNS + 1;
+					int y = 2 * (spot / MICRO_BENCHMARK_COLUMNS) - MICRO_BENCHMARK_ROWS + 1;
+					Facing facing = Facing(f);
+
+					transforms[t]->apply(&x, &y, &facing);
+					_checksum += x + y + facing;
+					transforms[t]->revert(&x, &y, &facing);
+					_checksum += x + y + facing;
+				}
+	return elapsedSince(start);
+}
+
+double MicroBenchmark::timeSampling() {
+	clock_t start = clock();
+	for (int k = 0; k < MICRO_BENCHMARK_SAMPLING_PASSES; k++)
+		for (int i = 0; i < _replays.size(); i++) {
+			const Stage* stage = _replays[i];
+			int samples = stage->duration() * BENCHMARK_SAMPLES_PER_BEAT;
+			for (int s = 1; s <= samples; s++) {
+				double partial = double(s) / BENCHMARK_SAMPLES_PER_BEAT;
+				for (int j = 0; j < stage->dancerCount(); j++) {
+					double x, y, nose;
+
+					if (locateMotion(stage->activeMotion(j, partial), partial, &x, &y, &nose))
+						_checksum += x + y;
+				}
+			}
+		}
+	return elapsedSince(start);
+}
+
+int MicroBenchmark::compare(const string& baselineFile) {
+	FILE* fp = fopen(baselineFile.c_str(), "r");
+	if (fp == null)
+		return -1;
+	_baselineFile = baselineFile;
+	_regressions.clear();
+	char line[512];
+	while (fgets(line, sizeof line, fp)) {
+		char name[64];
+		double baseline;
+
+		if (sscanf(line, " \"%63[^\"]\": { \"median\": %lf", name, &baseline) != 2)
+			continue;
+		for (int i = 0; i < _subsystems.size(); i++) {
+			const MicroSubsystem* s = _subsystems[i];
+			if (strcmp(name, s->name.c_str()) != 0)
+				continue;
+
+			// A slowdown too small to show in a run's total time is taken as noise.
+
+			double median = statistic(s, 0.5);
+			if (median > baseline * (1 + BENCHMARK_TOLERANCE) &&
+				(median - baseline) * s->operations / 1000000 > BENCHMARK_MIN_DELTA) {
+				string r;
+
+				r.printf("%s: median %.1f ns, baseline %.1f ns (%+.0f%%)", name, median, baseline, 100 * (median - baseline) / baseline);
+				_regressions.push_back(r);
+			}
+		}
+	}
+	fclose(fp);
+	return _regressions.size();
+}
+
+void MicroBenchmark::write(FILE* out) const {
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"version\": ");
+	writeJsonString(out, VERSION);
+	fprintf(out, ",\n\t\"grammar\": ");
+	writeJsonString(out, _grammar->filename());
+	fprintf(out, ",\n");
+	fprintf(out, "\t\"warmup\": %d,\n", BENCHMARK_WARMUP_RUNS);
+	fprintf(out, "\t\"runs\": %d,\n", _runs);
+	fprintf(out, "\t\"seed\": %u,\n", MICRO_BENCHMARK_SEED);
+	fprintf(out, "\t\"checksum\": %.3f,\n", _checksum);
+	fprintf(out, "\t\"units\": \"ns\",\n");
+	fprintf(out, "\t\"subsystems\": {\n");
+
+	// As with a Benchmark, each subsystem is on a line of its own for compare.
+
+	for (int i = 0; i < _subsystems.size(); i++) {
+		const MicroSubsystem* s = _subsystems[i];
+		fprintf(out, "\t\t");
+		writeJsonString(out, s->name);
+		fprintf(out, ": { \"median\": %.1f, \"p10\": %.1f, \"p90\": %.1f, \"min\": %.1f, \"max\": %.1f, \"operations\": %.0f }%s\n",
+				statistic(s, 0.5),
+				statistic(s, 0.1),
+				statistic(s, 0.9),
+				statistic(s, 0),
+				statistic(s, 1),
+				s->operations,
+				i < _subsystems.size() - 1 ? "," : "");
+	}
+	fprintf(out, "\t}");
+	if (_baselineFile.size()) {
+		fprintf(out, ",\n\t\"baseline\": ");
+		writeJsonString(out, _baselineFile);
+		fprintf(out, ",\n\t\"regressions\": [");
+		for (int i = 0; i < _regressions.size(); i++) {
+			fprintf(out, i ? ",\n\t\t" : "\n\t\t");
+			writeJsonString(out, _regressions[i]);
+		}
+		fprintf(out, _regressions.size() ? "\n\t]" : "]");
+	}
+	fprintf(out, "\n}\n");
+}
+/*
+ *	statistic
+ *
+ *	A percentile of the subsystem's times, in nanoseconds per operation.
+ */
+double MicroBenchmark::statistic(const MicroSubsystem* subsystem, double fraction) const {
+	if (subsystem->operations == 0)
+		return 0;
+	return percentile(subsystem->times, fraction) * 1000000 / subsystem->operations;
+}
+
+static double elapsedSince(clock_t start) {
+	return (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+/*
+ *	percentile
+ *
+ *	The nearest-rank percentile of the times: 0 gives the minimum, 0.5 the median and
+ *	1 the maximum.
+ */
+static double percentile(const vector<double>& times, double fraction) {
+	int n = times.size();
+	if (n == 0)
+		return 0;
+	double* sorted = new double[n];
+	for (int i = 0; i < n; i++)
+		sorted[i] = times[i];
+	qsort(sorted, n, sizeof (double), compareTimes);
+	int rank = int(ceil(fraction * n)) - 1;
+	if (rank < 0)
+		rank = 0;
+	if (rank >= n)
+		rank = n - 1;
+	double value = sorted[rank];
+	delete [] sorted;
+	return value;
+}
+
+static int compareTimes(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	if (x < y)
+		return -1;
+	else if (x > y)
+		return 1;
+	else
+		return 0;
+}
+
+static void writeJsonString(FILE* out, const string& s) {
+	fputc('"', out);
+	for (int i = 0; i < s.size(); i++) {
+		char c = s[i];
+		if (c == '"' || c == '\\')
+			fputc('\\', out);
+		fputc(c, out);
+	}
+	fputc('"', out);
+}
+/*
+ *	facingLinesOfSix
+ *
+ *	The standard 12 dancer setup: two lines of six facing each other, boys on the
+ *	left of their partners.
+ */
+static const Group* facingLinesOfSix(Context* context) {
+	Group* g = context->stage()->newGroup(GRID);
+	for (int i = 0; i < 6; i++) {
+		int x = 2 * i - 5;
+		g->insert(new Dancer(x, -1, BACK_FACING, i % 2 ? GIRL : BOY, i / 2 + 1));
+		g->insert(new Dancer(x, 1, FRONT_FACING, i % 2 ? BOY : GIRL, i / 2 + 4));
+	}
+	g->done();
+	return g;
+}
+
+}  // namespace dance
@@ -0,0 +1,183 @@
+#pragma once
+#include <stdio.h>
+#include "dance.h"
+
+namespace dance {
+
+class Anything;
+class Context;
+class Dance;
+class Grammar;
+class Sequence;
+class Stage;
+
+const int BENCHMARK_WARMUP_RUNS = 1;
+const int BENCHMARK_SAMPLES_PER_BEAT = 8;		// animation samples per beat, as the flow report takes them
+const double BENCHMARK_TOLERANCE = 0.10;		// a median this much above the baseline's is a regression
+const double BENCHMARK_MIN_DELTA = 5;			// milliseconds; smaller slowdowns are taken as noise
+
+const unsigned MICRO_BENCHMARK_SEED = 20100411;	// fixed, so that every run sees the same layouts
+const int MICRO_BENCHMARK_MAX_DEPTH = 6;			// concepts wrapped around the call that is parsed
+const int MICRO_BENCHMARK_LAYOUTS = 64;				// random layouts of each size
+const int MICRO_BENCHMARK_COLUMNS = 6;				// the random layouts are drawn from these grid spots
+const int MICRO_BENCHMARK_ROWS = 4;
+const int MICRO_BENCHMARK_PARSES = 2000;			// iterations of each timed loop, per run
+const int MICRO_BENCHMARK_MATCH_PASSES = 4;
+const int MICRO_BENCHMARK_PERFORM_PASSES = 10;
+const int MICRO_BENCHMARK_TRANSFORM_PASSES = 2000;
+const int MICRO_BENCHMARK_SAMPLING_PASSES = 20;
+
+enum BenchmarkPhase {
+	BENCH_LOAD,				// read calls.cdf
+	BENCH_COMPILE,			// build the parser state machines
+	BENCH_READ,				// read the dance files, and scale them up
+	BENCH_PARSE,			// parse every call of every sequence
+	BENCH_RUN,				// Dance::runAll
+	BENCH_MOTIONS,			// collect the motions of each stage, performed again
+	BENCH_SAMPLING,			// locate every dancer BENCHMARK_SAMPLES_PER_BEAT times a beat
+	BENCH_TOTAL,
+	BENCH_PHASES
+};
+/*
+ *	Benchmark
+ *
+ *	Times checking a corpus of dance files from a cold start, one phase at a time,
+ *	over repeated runs after BENCHMARK_WARMUP_RUNS untimed ones.  Each run loads its own
+ *	grammar and reads the dances afresh, so runs do not share parses, stages or
+ *	breathing solutions.  Every file can be scaled up by repeating its sequences.
+ *
+ *	The results are written as JSON: the median, 10th and 90th percentiles, minimum and
+ *	maximum of each phase in milliseconds.  Compared against a saved result, any phase
+ *	whose median has grown by more than BENCHMARK_TOLERANCE (and BENCHMARK_MIN_DELTA)
+ *	is reported as a regression.
+ */
+class Benchmark {
+public:
+	Benchmark(const string& grammarFile, int runs, int scale);
+
+	void addFile(const string& filename);
+	/*
+	 *	run
+	 *
+	 *	Returns false if the grammar or any of the files could not be read.
+	 */
+	bool run();
+	/*
+	 *	compare
+	 *
+	 *	Reads a result written by an earlier write and notes each phase whose median
+	 *	regressed.  Returns the number of regressions, or -1 if the baseline could not be
+	 *	read.
+	 */
+	int compare(const string& baselineFile);
+
+	void write(FILE* out) const;
+
+	const vector<string>& regressions() const { return _regressions; }
+
+private:
+	bool runOnce(bool timed);
+
+	bool runFile(const string& filename, const Grammar* grammar, double* elapsed);
+
+	double statistic(BenchmarkPhase phase, double fraction) const;
+
+	string				_grammarFile;
+	vector<string>		_files;
+	int					_runs;
+	int					_scale;
+	vector<double>		_times[BENCH_PHASES];	// milliseconds, one per timed run
+	int					_sequences;				// in the last run
+	int					_calls;
+	int					_samples;
+	double				_checksum;				// of the sampled positions, so the sampling is not optimized away
+	string				_baselineFile;
+	vector<string>		_regressions;
+};
+
+class MicroSubsystem {
+public:
+	string			name;
+	double			operations;			// in each run
+	vector<double>	times;				// milliseconds, one per timed run
+};
+/*
+ *	MicroBenchmark
+ *
+ *	Times the engine's pieces one at a time, each on inputs generated the same way in
+ *	every run, so that a change to one piece can be measured without the noise of a
+ *	whole dance:
+ *
+ *		tokenize/N		Grammar::tokenizeCall of a call wrapped in N concepts
+ *		stateMachine/N	Grammar::matchAnycall of the same tokens
+ *		matchSome/D		Formation::matchSome of every formation against MICRO_BENCHMARK_LAYOUTS
+ *						random layouts of D dancers
+ *		perform/D		Stage::perform, and so Group::buildTiling, of a few plain calls from
+ *						standard D dancer setups, and from the positions they lead to
+ *		breathe/D		Stage::breathe of the same stages, with no breathing solutions cached
+ *		transform		Transform::apply and revert under each rotation and the mirror
+ *		sampling		locateMotion of every dancer in the performed stages,
+ *						BENCHMARK_SAMPLES_PER_BEAT times a beat
+ *
+ *	Every loop runs a fixed number of iterations.  Results are written as JSON in
+ *	nanoseconds per operation, and can be compared against a saved result as a
+ *	Benchmark's are.
+ */
+class MicroBenchmark {
+public:
+	MicroBenchmark(const Grammar* grammar, int runs);
+
+	~MicroBenchmark();
+
+	void run();
+
+	int compare(const string& baselineFile);
+
+	void write(FILE* out) const;
+
+	const vector<string>& regressions() const { return _regressions; }
+
+private:
+	void prepare();
+
+	void runOnce(bool timed);
+
+	void addSubsystem(const string& name, double operations);
+
+	const Group* randomLayout(int dancers, Context* context);
+
+	Stage* performOnce(const Group* start, const Anything* call);
+
+	double timeTokenize(int depth);
+
+	double timeStateMachine(int depth);
+
+	double timeMatching(const vector<const Group*>& layouts);
+
+	void timePerforming(int setup, double* performing, double* breathing);
+
+	double timeTransforms();
+
+	double timeSampling();
+
+	double statistic(const MicroSubsystem* subsystem, double fraction) const;
+
+	const Grammar*				_grammar;
+	int							_runs;
+	Sequence*					_sequence;
+	Stage*						_storage;			// holds the layouts and parsed calls
+	vector<MicroSubsystem*>		_subsystems;
+	string						_texts[MICRO_BENCHMARK_MAX_DEPTH + 1];
+	vector<Token>				_tokens[MICRO_BENCHMARK_MAX_DEPTH + 1];
+	vector<const Group*>		_layouts[2];		// random layouts of 8 and of 12 dancers
+	vector<const Group*>		_starts[2];			// parallel to _calls, of 8 and of 12 dancers
+	vector<const Anything*>		_calls[2];
+	vector<Stage*>				_replays;			// each start and call performed once, motions collected
+	int							_samples;
+	double						_checksum;			// of the results, so that no loop is optimized away
+	RandomNumbers				_random;
+	string						_baselineFile;
+	vector<string>				_regressions;
+};
+
+}  // namespace dance
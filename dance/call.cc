@@ -55,10 +55,10 @@ void Plan::splice(Plan *sub) {
 	_interval = sub->_interval;
 	sub->_interval = null;
 	_locals.clear();
-	map<const Term, Anyone*>::iterator li = sub->_locals.begin();
+	map<const Term, const Anyone*>::iterator li = sub->_locals.begin();
 	while (li.valid()) {
 		const Term* key = li.key();
-		Anyone* a = *li;
+		const Anyone* a = *li;
 		_locals.put(key, a);
 		li.next();
 	}
@@ -497,6 +497,12 @@ bool Step::perform(Context* context) {
 	if (_interval == null)
 		_interval = new Interval(_plan->interval(), true);
 	unsigned lastActiveMask = 0;
+	// Tiles are performed in order on this thread.  Although each tile has its own
+	// start group and interval, performing one still constructs steps lazily (which
+	// parses through the grammar's lazily built tables), allocates from the one Stage,
+	// reports failures up through this step, runs timing::Timer and may use the
+	// static scratch dancer in Group::dancerByLocation.  None of that is safe to share
+	// between threads.
 	for (int i = 0; i < _tiles.size(); i++) {
 		if (_tiles[i]->active()) {
 			if (_tiles[i]->enclosing() != this)
@@ -775,6 +781,7 @@ bool DefinitionStep::construct(Context* context, TileAction tileAction) {
 	if (failed())
 		return false;
 	if (_tiles.size() == 0) {
+		context->stage()->useDefinition(_definition);
 		const vector<VariantTile>& tiles = _definition->tiles();
 		TileSearch bestTiling[MAX_DANCERS];
 
@@ -176,6 +176,15 @@ public:
 	}
 
 	const Group* beforeBreathing() const { return _beforeBreathing; }
+	/*
+	 *	retainFinalOnly
+	 *
+	 *	Forget the per-tile outcomes, leaving only the final group.
+	 */
+	void retainFinalOnly() {
+		_outcome.clear();
+		_beforeBreathing = null;
+	}
 
 private:
 	enum CompactifyRelation {
@@ -291,9 +300,9 @@ public:
 
 	unsigned lastActiveMask() const;
 
-	bool defineLocal(const Term* name, Anyone* value) { return _locals.insert(name, value); }
+	bool defineLocal(const Term* name, const Anyone* value) { return _locals.insert(name, value); }
 
-	Anyone* get(const Term* name) const { return *_locals.get(name); }
+	const Anyone* get(const Term* name) const { return *_locals.get(name); }
 
 	const Group* start() const { return _start; }
 
@@ -343,7 +352,7 @@ private:
 	const Explanation*			_cause;
 	const Variant*				_applied;
 	const Pattern*				_matched;
-	map<const Term, Anyone*>	_locals;
+	map<const Term, const Anyone*>	_locals;
 	int							_phantomCount;
 
 };
@@ -356,7 +365,7 @@ private:
  */
 class Stage : public Plan {
 public:
-	Stage(const Sequence* sequence, const Group* start);
+	Stage(const Sequence* sequence, const Group* start, const TermPool* termPool);
 
 	~Stage();
 
@@ -365,6 +374,57 @@ public:
 	void collectMotions();
 
 	void checkFlow(FlowState* flowState);
+	/*
+	 *	checkCollisions
+	 *
+	 *	Warns about any pair of dancers whose paths run through each other during the
+	 *	stage.  Dancers passing face to face, both walking forward with their centers
+	 *	a shoulder's clearance apart, are not reported, since that is how passing right
+	 *	shoulders is drawn.  Nor are dancers turning together about one center, as in a
+	 *	swing, arm turn or courtesy turn.
+	 */
+	void checkCollisions();
+	/*
+	 *	prune
+	 *
+	 *	Once the motions are collected, the plan tree is only needed for drilling down
+	 *	into the stage.  This discards the plans, steps, tiles and any intermediate
+	 *	groups, keeping the call, start, final dancers, motions and explanations.  The
+	 *	grammar version is recorded so that Sequence::expandStage can rebuild the tree.
+	 */
+	void prune(fileSystem::TimeStamp grammarVersion);
+
+	bool pruned() const { return _pruned; }
+
+	fileSystem::TimeStamp grammarVersion() const { return _grammarVersion; }
+	/*
+	 *	useDefinition
+	 *
+	 *	Notes that the stage was built from the definition, so that a saved result
+	 *	for the stage can be checked against later edits of the grammar.
+	 */
+	void useDefinition(const Definition* definition);
+
+	const vector<const Definition*>& definitionsUsed() const { return _definitionsUsed; }
+	/*
+	 *	variantsApplied
+	 *
+	 *	The variants the stage's plans applied, each with the pattern it matched, as
+	 *	counted for coverage.  A call under a concept is not counted, since the concept
+	 *	may change it beyond recognition, but the parts of a transparent_ call are.  The
+	 *	list is gathered from the plan tree on first use, or when the stage is pruned, so
+	 *	it survives pruning.
+	 */
+	const vector<VariantTile>& variantsApplied() const;
+	/*
+	 *	replay
+	 *
+	 *	For a pruned stage, the fully expanded copy built by Sequence::expandStage, if any.
+	 *	It is owned by, and deleted with, this stage.
+	 */
+	const Stage* replay() const { return _replay; }
+
+	void setReplay(Stage* replay) { _replay = replay; }
 
 	void print() const;
 
@@ -402,11 +462,11 @@ public:
 
 	Anything* newAnything(bool inDefinition, const Definition* definition);
 
-	Integer* newInteger(int value);
+	const Integer* newInteger(int value);
 
-	Anyone* newAnyone(DancerSet dancerSet, unsigned mask, const Anyone* left, const Anyone* right, Level level);
+	const Anyone* newAnyone(DancerSet dancerSet, unsigned mask, const Anyone* left, const Anyone* right, Level level);
 
-	Fraction* newFraction(int whole, int num, int denom);
+	const Fraction* newFraction(int whole, int num, int denom);
 
 	Straight* newStraight(Point start, Point end, double startNose, double noseMotion, beats duration);
 
@@ -415,15 +475,28 @@ public:
 	int dancerCount() const { return _motions.dancerCount(); }
 
 	Motion* motion(int index) const { return _motions.motion(index); }
+	/*
+	 *	activeMotion
+	 *
+	 *	The motion of the given dancer in progress at the given beat of the stage, found
+	 *	through the timelines built by collectMotions.
+	 */
+	const Motion* activeMotion(int index, double partial) const;
 
 	beats duration() const { return _motions.duration(); }
 
 	const MotionSet* motions() const { return &_motions; }
 
 	const Sequence* sequence() const { return _sequence; }
+	// Test API
+	const vector<Group*>& groups() const { return _dancers; }
 
 private:
 	const Sequence*			_sequence;
+	const TermPool*			_termPool;
+	bool					_pruned;
+	fileSystem::TimeStamp	_grammarVersion;
+	Stage*					_replay;
 	MotionSet				_motions;
 	vector<Plan*>			_plans;
 	vector<Step*>			_steps;
@@ -432,6 +505,43 @@ private:
 	vector<Term*>			_terms;
 	vector<Explanation*>	_explanations;
 	vector<Motion*>			_allocedMotions;
+	vector<MotionTimeline*>	_timelines;
+	vector<const Definition*> _definitionsUsed;
+	mutable bool			_variantsGathered;
+	mutable vector<VariantTile> _variantsApplied;
+};
+
+const int POOLED_INTEGERS = 64;
+const int POOLED_WHOLES = 8;
+const int POOLED_DENOMINATOR = 8;
+const int POOLED_FRACTIONS = POOLED_WHOLES * POOLED_DENOMINATOR * (POOLED_DENOMINATOR + 1) / 2;
+const int POOLED_DANCERS = 32;
+/*
+ *	TermPool
+ *
+ *	Integer, Fraction and simple Anyone terms never change once built, so the
+ *	values that turn up over and over (small integers, halves, quarters and so on,
+ *	single named dancers) are built once and shared by every Stage that draws from
+ *	the pool.  Each accessor returns null when the value is not pooled, in which case
+ *	the Stage allocates a term of its own.
+ */
+class TermPool {
+public:
+	TermPool();
+
+	~TermPool();
+
+	const Integer* integer(int value) const;
+
+	const Fraction* fraction(int whole, int num, int denom) const;
+
+	const Anyone* anyone(DancerSet dancerSet, unsigned mask, const Anyone* left, const Anyone* right, Level level) const;
+
+private:
+	const Integer*	_integers[POOLED_INTEGERS];
+	const Fraction*	_fractions[POOLED_FRACTIONS];
+	const Anyone*	_dancers[POOLED_DANCERS];
+	vector<Term*>	_terms;
 };
 
 class Tile {
@@ -0,0 +1,121 @@
+#include "../common/platform.h"
+#include "coverage.h"
+
+#include "../common/file_system.h"
+#include "../common/timing.h"
+#include "call.h"
+#include "stage_cache.h"
+
+namespace dance {
+
+VariantCoverage::VariantCoverage() {
+	_sequences = 0;
+	_performed = 0;
+}
+
+string VariantCoverage::key(const Variant* variant, const Pattern* pattern) {
+	const Definition* d = variant->definition();
+	int v;
+	for (v = 0; v < d->variants().size(); v++)
+		if (d->variants()[v] == variant)
+			break;
+	int p;
+	for (p = 0; p < variant->recognizers().size(); p++)
+		if (variant->recognizers()[p] == pattern)
+			break;
+	if (p == variant->recognizers().size())
+		p = -1;
+	string s;
+
+	s.printf("%s/%d/%d", d->label().c_str(), v, p);
+	return s;
+}
+
+void VariantCoverage::add(const string& key, int count) {
+	*_counts.get(key) += count;
+}
+
+void VariantCoverage::add(const Stage* stage) {
+	const vector<VariantTile>& applied = stage->variantsApplied();
+	for (int i = 0; i < applied.size(); i++)
+		add(key(applied[i].variant, applied[i].pattern), 1);
+}
+
+int VariantCoverage::cover(Dance* dance, const Grammar* grammar) {
+	timing::Timer t("VariantCoverage::cover");
+	int performed = 0;
+	StageCache* cache = dance->stageCache();
+	const vector<Sequence*>& sequences = dance->sequences();
+	for (int i = 0; i < sequences.size(); i++) {
+		Sequence* seq = sequences[i];
+		const SequenceRecord* r = cache ? cache->lookup(seq, grammar) : null;
+		if (r) {
+			for (int j = 0; j < r->variants.size(); j++)
+				add(r->variants[j], 1);
+		} else {
+			seq->updateStages(grammar);
+			const vector<const Stage*>& stages = seq->stages();
+			for (int j = 0; j < stages.size(); j++)
+				add(stages[j]);
+			seq->clearStages();
+			performed++;
+		}
+	}
+	dance->saveStageCache();
+	_sequences += sequences.size();
+	_performed += performed;
+	return performed;
+}
+
+bool VariantCoverage::cover(const string& filename, const Grammar* grammar) {
+	Dance d(fileSystem::basename(filename), filename);
+	if (!d.read())
+		return false;
+	cover(&d, grammar);
+	return true;
+}
+
+void VariantCoverage::merge(const VariantCoverage& other) {
+	dictionary<int>::iterator i = other._counts.begin();
+	while (i.valid()) {
+		add(i.key(), *i);
+		i.next();
+	}
+	_sequences += other._sequences;
+	_performed += other._performed;
+}
+
+int VariantCoverage::count(const string& key) const {
+	return *_counts.get(key);
+}
+
+int VariantCoverage::write(FILE* out, const Grammar* grammar, Level level) const {
+	int uncovered = 0;
+	int covered = 0;
+	for (const Grammar* g = grammar; g; g = g->backupGrammar()) {
+		const vector<Definition*>& definitions = g->definitions();
+		for (int i = 0; i < definitions.size(); i++) {
+			const vector<Variant*>& variants = definitions[i]->variants();
+			for (int j = 0; j < variants.size(); j++) {
+				const Variant* v = variants[j];
+				if (level > NO_LEVEL && v->effectiveLevel() != level)
+					continue;
+				int patterns = v->recognizers().size();
+				for (int k = 0; k < patterns || k == 0; k++) {
+					const Pattern* p = k < patterns ? v->recognizers()[k] : null;
+					int n = count(key(v, p));
+					fprintf(out, "%8d%c %s / %s\n", n, n ? ' ' : '*', definitions[i]->label().c_str(), 
+							p ? p->formation()->name().c_str() : "<default>");
+					if (n)
+						covered++;
+					else
+						uncovered++;
+				}
+			}
+		}
+	}
+	fprintf(out, "Total %d uncovered / %d covered, from %d sequences (%d performed)\n", uncovered, covered, _sequences, _performed);
+	return uncovered;
+}
+
+}  // namespace dance
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdio.h>
+#include "dance.h"
+
+namespace dance {
+
+class Dance;
+class Grammar;
+class Pattern;
+class Stage;
+class Variant;
+/*
+ *	VariantCoverage
+ *
+ *	Counts how often each variant of each definition was applied, by the pattern it
+ *	matched, over any number of sequences.  A count is kept under a key naming the
+ *	definition, the variant's place in it and the pattern's place among the variant's
+ *	recognizers, so that counts can be saved, and merged from separate runs.
+ *
+ *	The variants each sequence applied are saved in its record in the dance's
+ *	StageCache, so covering a dance again after a grammar edit performs only the
+ *	sequences the edit sent back to be evaluated.
+ */
+class VariantCoverage {
+public:
+	VariantCoverage();
+
+	static string key(const Variant* variant, const Pattern* pattern);
+
+	void add(const string& key, int count);
+
+	void add(const Stage* stage);
+	/*
+	 *	cover
+	 *
+	 *	Adds the variants applied by every sequence of the dance: from the stage cache
+	 *	where the saved record is still valid, otherwise by performing the sequence.
+	 *	The stage cache is saved afterwards.  Returns the number of sequences performed.
+	 */
+	int cover(Dance* dance, const Grammar* grammar);
+
+	bool cover(const string& filename, const Grammar* grammar);
+
+	void merge(const VariantCoverage& other);
+
+	int count(const string& key) const;
+	/*
+	 *	write
+	 *
+	 *	Lists each variant and recognizer of the grammar at the given level (every level
+	 *	for NO_LEVEL) with its count, marking the uncovered ones.  Returns the number
+	 *	uncovered.
+	 */
+	int write(FILE* out, const Grammar* grammar, Level level) const;
+
+	int sequences() const { return _sequences; }
+
+	int performed() const { return _performed; }
+
+private:
+	mutable dictionary<int>		_counts;
+	int							_sequences;
+	int							_performed;		// sequences not found in a stage cache
+};
+
+}  // namespace dance
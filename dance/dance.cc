@@ -4,6 +4,7 @@
 #include <ctype.h>
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include "../common/file_system.h"
 #include "../common/machine.h"
 #include "../common/timing.h"
@@ -11,6 +12,7 @@
 #include "call.h"
 #include "dance_ui.h"
 #include "motion.h"
+#include "stage_cache.h"
 
 namespace dance {
 
@@ -23,6 +25,23 @@ bool verboseBreathing = false;
 bool verboseParsing = false;
 bool verboseMatching = false;
 bool showUI = true;
+bool leanStages = false;
+bool exploitSymmetry = true;
+bool tabulateOutcomes = true;
+string renderFolder;
+string flowReportFile;
+string sdCheckFile;
+string coverageFile;
+string benchmarkFile;
+string benchmarkBaseline;
+int benchmarkRuns = 5;
+int benchmarkScale = 1;
+string microBenchmarkFile;
+string microBenchmarkBaseline;
+string generateFile;
+string generateLevel;
+int generateCount = 100;
+unsigned generateSeed;
 
 bool anyVerbose() {
 	return verboseOutput || verboseBreathing || verboseParsing || verboseMatching;
@@ -92,6 +111,12 @@ Sequence::Sequence(Dance* dance) {
 	_level = NO_LEVEL;				// A sequence defaults to no specified level
 	status = SEQ_UNCHECKED;
 	_danceType = D_4COUPLE;
+	_changed = false;
+	_loaded = true;
+	_hashed = false;
+	_textHash = 0;
+	_offset = 0;
+	_length = 0;
 }
 
 Sequence::~Sequence() {
@@ -100,16 +125,20 @@ Sequence::~Sequence() {
 
 void Sequence::setLevel(Level newLevel) {
 	_lastChecked.clear();
+	_hashed = false;
 	_level = newLevel;
 }
 
 void Sequence::setLevelName(const string& name) {
 	_lastChecked.clear();
+	_hashed = false;
 	_level = *levelValues.get(name);
 }
 
 void Sequence::setCall(int index, const string& call) {
+	load();
 	_lastChecked.clear();
+	_hashed = false;
 	if (index == _text.size())
 		_text.push_back(call);
 	else
@@ -121,6 +150,7 @@ void Sequence::setLastChecked(fileSystem::TimeStamp t) {
 }
 
 void Sequence::append(const string& text) {
+	_hashed = false;
 	_text.push_back(text);
 }
 
@@ -128,6 +158,33 @@ void Sequence::appendNotes(const string &text) {
 	_notes.push_back(text);
 }
 
+void Sequence::setLocation(__int64 offset, int length) {
+	_offset = offset;
+	_length = length;
+	_loaded = false;
+}
+
+void Sequence::load() const {
+	if (_loaded)
+		return;
+	_loaded = true;
+	if (!_dance->readCalls(_offset, _length, &_text, &_notes))
+		printf("%s: could not read the calls of a sequence\n", _dance->filename().c_str());
+}
+
+unsigned __int64 Sequence::textHash() const {
+	if (!_hashed) {
+		_textHash = StageCache::textHash(_level, text());
+		_hashed = true;
+	}
+	return _textHash;
+}
+
+void Sequence::setTextHash(unsigned __int64 hash) {
+	_textHash = hash;
+	_hashed = true;
+}
+
 bool Sequence::run(bool allowUnresolved, const Grammar* grammar) {
 	updateStages(grammar);
 	for (int i = 0; i < _stages.size(); i++)
@@ -149,6 +206,18 @@ bool Sequence::current(const Grammar* grammar) {
 
 bool Sequence::updateStatus(const Grammar* grammar) {
 	if (grammar->lastChanged() > _lastChecked || status == SEQ_UNCHECKED) {
+		// A saved result is still good if none of the definitions the sequence used
+		// has changed, so the calls need not be performed again just for the status.
+
+		StageCache* cache = _dance ? _dance->stageCache() : null;
+		if (cache) {
+			const SequenceRecord* r = cache->lookup(this, grammar);
+			if (r) {
+				status = (SequenceStatus)r->status;
+				_lastChecked.touch();
+				return true;
+			}
+		}
 		updateStages(grammar);
 		clearStages();
 		return true;
@@ -156,6 +225,39 @@ bool Sequence::updateStatus(const Grammar* grammar) {
 		return false;
 }
 
+const Stage* Sequence::expandStage(int index, const Grammar* grammar) {
+	if (index < 0 || index >= _stages.size())
+		return null;
+	if (_stages[index]->pruned() &&
+		grammar->lastChanged() > _stages[index]->grammarVersion()) {
+		updateStages(grammar);
+		if (index >= _stages.size())
+			return null;
+	}
+	Stage* stage = (Stage*)_stages[index];
+	if (!stage->pruned())
+		return stage;
+	if (stage->replay() == null) {
+		timing::Timer t("Sequence::expandStage");
+
+		// The pruned stage kept its parsed call and its start, so performing
+		// them again under the same grammar reproduces the discarded plan tree.
+		// Flow warnings stay with the pruned stage and are not re-checked.
+
+		Context context(this, grammar);
+		Stage* replay = new Stage(this, stage->start(), grammar->termPool());
+		context.startStage(replay);
+		replay->setCall(stage->call());
+		replay->perform(null, &context, TILE_ALL);
+		replay->breathe(&context);
+		context.endStage();
+		if (!replay->failed())
+			replay->collectMotions();
+		stage->setReplay(replay);
+	}
+	return stage->replay();
+}
+
 void Sequence::clearStages() {
 	for (int i = 0; i < _stages.size(); i++)
 		deletingStage.fire(_stages[i]);
@@ -165,6 +267,7 @@ void Sequence::clearStages() {
 bool Sequence::updateStages(const Grammar* grammar) {
 	timing::Timer t("Sequence::updateStages");
 
+	load();
 	if (grammar->lastChanged() > _lastChecked || _stages.size() != _text.size()) {
 		clearStages();
 
@@ -176,7 +279,7 @@ bool Sequence::updateStages(const Grammar* grammar) {
 		stageStart = Group::home;
 		status = SEQ_UNCHECKED;
 		for (int i = 0; i < _text.size(); i++) {
-			Stage* stage = new Stage(this, stageStart);
+			Stage* stage = new Stage(this, stageStart, grammar->termPool());
 			_stages.push_back(stage);
 			context.startStage(stage);
 			if (_text[i].size() == 0)
@@ -207,10 +310,13 @@ bool Sequence::updateStages(const Grammar* grammar) {
 						else {
 							stage->collectMotions();
 							stage->checkFlow(flowState);
+							stage->checkCollisions();
 							if (verboseOutput)
 								stage->print();
 							if (!stage->failed()) {
 								stageStart = endOfStage;
+								if (leanStages)
+									stage->prune(grammar->lastChanged());
 								continue;
 							}
 						}
@@ -237,6 +343,8 @@ bool Sequence::updateStages(const Grammar* grammar) {
 			else
 				status = SEQ_UNRESOLVED;
 		}
+		if (_dance && _dance->stageCache())
+			_dance->stageCache()->record(this, grammar);
 		_lastChecked.touch();
 		return true;
 	} else
@@ -258,12 +366,14 @@ void Sequence::print() {
 		printf("    Created with: %s\n", createdWith.c_str());
 	if (comment.size())
 		printf("    %s\n", comment.c_str());
+	load();
 	for (int i = 0; i < _text.size(); i++)
 		printf("  %4d: %s\n", i + 1, _text[i].c_str());
 	printf("\n");
 }
 
 void Sequence::write(FILE* fp) {
+	load();
 	fprintf(fp, "S%I64d\n", created);
 	if (modified)
 		fprintf(fp, "M%I64d\n", modified);
@@ -383,6 +493,34 @@ bool ambiguous(Facing facing) {
 	}
 }
 
+void facingToAngles(Facing facing, double* noseAngle, double* secondNoseAngle) {
+	*secondNoseAngle = NO_NOSE;
+	switch (facing) {
+	case	HEAD_FACING:
+		*secondNoseAngle = -PI / 2;
+	case	BACK_FACING:
+		*noseAngle = PI / 2;
+		break;
+
+	case	SIDE_FACING:
+		*secondNoseAngle = PI;
+	case	RIGHT_FACING:
+		*noseAngle = 0;
+		break;
+
+	case	LEFT_FACING:
+		*noseAngle = PI;
+		break;
+
+	case	FRONT_FACING:
+		*noseAngle = -PI / 2;
+		break;
+
+	case	ANY_FACING:
+		*noseAngle = NO_NOSE;
+	}
+}
+
 int oppositeCouple(const Sequence* sequence, int couple) {
 	static int o2_and_4[] = { 0, 3, 4, 1, 2 };
 	static int o6[] = { 0, 4, 5, 6, 1, 2, 3 };
@@ -405,82 +543,173 @@ Dance::Dance(const string& label, const string& filename) {
 	_levelName = "*";					// Magic 'name' of the highest level
 	_level = NO_LEVEL;					// Dances default to unspecified level
 	_danceType = D_UNSPECIFIED;			// Dances default to unspecified type (2 couple, 4 cou0ple, 6 couple, hex, etc.)
+	_fileBytes = 0;
+	_journalBytes = 0;
+	_changedCount = 0;
+	_replaceAt = -1;
+	_stageCache = null;
+	_stageCacheDisabled = false;
 }
 
 Dance::~Dance() {
 	_sequences.deleteAll();
+	delete _stageCache;
 }
 
 bool Dance::read() {
-	FILE* fp = fileSystem::openTextFile(_filename);
+	timing::Timer t("Dance::read");
+	_replaceAt = -1;
+	_journalBytes = 0;
+	if (!readIndex() && !readFile(_filename, &_fileBytes))
+		return false;
+	string journal = journalFilename();
+	if (fileSystem::exists(journal))
+		return readFile(journal, &_journalBytes);
+	return true;
+}
+
+bool Dance::readFile(const string& filename, __int64* bytes) {
+	FILE* fp = fileSystem::openTextFile(filename);
 	if (fp == null)
 		return false;
-	string contents;
-	bool result = fileSystem::readAll(fp, &contents);
-	fclose(fp);
-	if (!result)
-		return result;
-	vector<string> lines;
-	contents.split('\n', &lines);
+	*bytes = 0;
+	int capacity = DANCE_READ_BUFFER;
+	char* buffer = new char[capacity + 1];
+	int filled = 0;
+	int line = 0;
+	bool result = true;
 	Sequence* sequence = null;
-	for (int i = 0; i < lines.size(); i++) {
-		fileSystem::TimeStamp t;
-
-		if (lines[i].size() == 0)
-			continue;
-		switch (lines[i][0]) {
-		case	'=':
-			_levelName = lines[i].substr(1);
-			_level = *levelValues.get(_levelName);
+	while (result) {
+		int n = int(fread(buffer + filled, 1, capacity - filled, fp));
+		filled += n;
+		*bytes += n;
+		bool atEnd = feof(fp) || ferror(fp);
+		char* record = buffer;
+		char* end = buffer + filled;
+
+		// Records are scanned where they lie in the buffer; only the partial record
+		// at the end is carried over to the next read.
+
+		while (record < end) {
+			char* eol = (char*)memchr(record, '\n', end - record);
+			if (eol == null) {
+				if (!atEnd)
+					break;
+				eol = end;
+			}
+			*eol = 0;
+			line++;
+			if (!readRecord(filename, record, eol, line, &sequence)) {
+				result = false;
+				break;
+			}
+			record = eol + 1;
+		}
+		if (atEnd)
 			break;
+		filled = 0;
+		if (record < end) {
+			filled = end - record;
+			memmove(buffer, record, filled);
+		}
+		if (filled == capacity) {
+			char* larger = new char[2 * capacity + 1];
+			memcpy(larger, buffer, filled);
+			delete [] buffer;
+			buffer = larger;
+			capacity *= 2;
+		}
+	}
+	if (ferror(fp)) {
+		printf("%s: read error\n", filename.c_str());
+		result = false;
+	}
+	fclose(fp);
+	delete [] buffer;
+	return result;
+}
 
-		case	'S':
-			sequence = newSequence();
-			sequence->created = parseLongLong(lines[i], 1);
-			break;
+bool Dance::readRecord(const string& filename, char* text, char* end, int line, Sequence** sequence) {
+	if (end > text && end[-1] == '\r')
+		*--end = 0;
+	if (end == text)
+		return true;
+	if (*sequence == null && text[0] != '=' && text[0] != 'S' && text[0] != '@') {
+		printf("%s line %d: Record outside of any sequence\n", filename.c_str(), line);
+		return false;
+	}
+	fileSystem::TimeStamp t;
+	switch (text[0]) {
+	case	'=':
+		_levelName = text + 1;
+		_level = *levelValues.get(_levelName);
+		break;
 
-		case	'M':
-			sequence->modified = parseLongLong(lines[i], 1);
-			break;
+	case	'@':
+		_replaceAt = int(parseLongLong(text + 1));
+		break;
 
-		case	'X':
-			t.setValue(parseLongLong(lines[i], 1));
-			sequence->setLastChecked(t);
-			break;
+	case	'S':
+		if (_replaceAt >= 0 && _replaceAt < _sequences.size()) {
+			*sequence = new Sequence(this);
+			delete _sequences[_replaceAt];
+			_sequences[_replaceAt] = *sequence;
+		} else
+			*sequence = newSequence();
+		_replaceAt = -1;
+		(*sequence)->created = parseLongLong(text + 1);
+		break;
 
-		case	's':
-			sequence->status = (SequenceStatus)(lines[i][1] - 'a');
-			break;
+	case	'M':
+		(*sequence)->modified = parseLongLong(text + 1);
+		break;
 
-		case	' ':
-			sequence->setLevelName(lines[i].substr(1));
-			break;
+	case	'X':
+		t.setValue(parseLongLong(text + 1));
+		(*sequence)->setLastChecked(t);
+		break;
 
-		case	'/':
-			if (!lines[i].substr(1).unescapeC(&sequence->comment))
-				return false;
-			break;
+	case	's':
+		if (text[1] < 'a' || text[1] > 'a' + SEQ_READY) {
+			printf("%s line %d: Unknown sequence status\n", filename.c_str(), line);
+			return false;
+		}
+		(*sequence)->status = (SequenceStatus)(text[1] - 'a');
+		break;
 
-		case	'!':
-			sequence->createdWith = lines[i].substr(1);
-			break;
+	case	' ':
+		(*sequence)->setLevelName(text + 1);
+		break;
 
-		case	'.':
-			sequence->append(lines[i].substr(1));
-			break;
+	case	'/':
+		if (!string(text + 1).unescapeC(&(*sequence)->comment)) {
+			printf("%s line %d: Badly escaped comment\n", filename.c_str(), line);
+			return false;
+		}
+		break;
 
-		case	'#': {
-			string notes;
+	case	'!':
+		(*sequence)->createdWith = text + 1;
+		break;
 
-			if (!lines[i].substr(1).unescapeC(&notes))
-				return false;
-			sequence->appendNotes(notes);
-			break;
-		}
+	case	'.':
+		(*sequence)->append(text + 1);
+		break;
 
-		default:
+	case	'#': {
+		string notes;
+
+		if (!string(text + 1).unescapeC(&notes)) {
+			printf("%s line %d: Badly escaped notes\n", filename.c_str(), line);
 			return false;
 		}
+		(*sequence)->appendNotes(notes);
+		break;
+	}
+
+	default:
+		printf("%s line %d: Unrecognized record '%c'\n", filename.c_str(), line, text[0]);
+		return false;
 	}
 	return true;
 }
@@ -533,14 +762,314 @@ bool Dance::runAll(bool allowUnresolved, const Grammar* grammar) {
 }
 
 bool Dance::save() {
+	// Sequences still waiting to be read from the file must be read before the file
+	// is rewritten.
+
+	for (int i = 0; i < _sequences.size(); i++)
+		_sequences[i]->load();
 	FILE* fp = fileSystem::createTextFile(_filename);
 	if (fp == null)
 		return false;
+	vector<__int64> offsets;
+	vector<int> lengths;
 	fprintf(fp, "=%s\n", levels[_level].c_str());
-	for (int i = 0; i < _sequences.size(); i++)
+	for (int i = 0; i < _sequences.size(); i++) {
+		__int64 offset = ftell(fp);
 		_sequences[i]->write(fp);
+		_sequences[i]->setChanged(false);
+		offsets.push_back(offset);
+		lengths.push_back(int(ftell(fp) - offset));
+	}
+	_fileBytes = ftell(fp);
+	bool written = ferror(fp) == 0;
+	if (fclose(fp) != 0)
+		written = false;
+	if (!written)
+		return false;
+	if (!writeIndex(offsets, lengths))
+		printf("%s: could not write the index\n", indexFilename().c_str());
+	saveStageCache();
+
+	// Everything in the journal is now in the file itself, and replaying it over the
+	// new file could undo later edits, so empty it.
+
+	_changedCount = 0;
+	string journal = journalFilename();
+	if (_journalBytes || fileSystem::exists(journal)) {
+		fp = fileSystem::createTextFile(journal);
+		if (fp == null || fclose(fp) != 0)
+			return false;
+		_journalBytes = 0;
+	}
+	return true;
+}
+
+bool Dance::saveChanges() {
+	if (needsCompaction())
+		return save();
+	if (_changedCount == 0)
+		return true;
+	FILE* fp = fopen(journalFilename().c_str(), "a");
+	if (fp == null)
+		return false;
+	for (int i = 0; i < _sequences.size(); i++) {
+		Sequence* s = _sequences[i];
+		if (!s->changed())
+			continue;
+		fprintf(fp, "@%d\n", i);
+		s->write(fp);
+		s->setChanged(false);
+	}
+	_changedCount = 0;
+	_journalBytes = ftell(fp);
+	saveStageCache();
+	bool result = ferror(fp) == 0;
+	if (fclose(fp) != 0)
+		result = false;
+	return result;
+}
+
+bool Dance::compact() {
+	if (_journalBytes == 0)
+		return true;
+	return save();
+}
+
+bool Dance::needsCompaction() const {
+	return _fileBytes == 0 || _journalBytes > _fileBytes / DANCE_JOURNAL_FRACTION;
+}
+
+StageCache* Dance::stageCache() {
+	if (_stageCache == null && _filename.size() && !_stageCacheDisabled) {
+		_stageCache = new StageCache(_filename + ".stages");
+		_stageCache->read();
+	}
+	return _stageCache;
+}
+
+void Dance::disableStageCache() {
+	delete _stageCache;
+	_stageCache = null;
+	_stageCacheDisabled = true;
+}
+
+bool Dance::saveStageCache() {
+	if (_stageCache == null || !_stageCache->modified())
+		return true;
+	if (_stageCache->write())
+		return true;
+	printf("%s.stages: could not write the stage cache\n", _filename.c_str());
+	return false;
+}
+
+void Dance::touch(Sequence* sequence) {
+	if (!sequence->changed()) {
+		sequence->setChanged(true);
+		_changedCount++;
+	}
+}
+
+string Dance::journalFilename() const {
+	return _filename + ".journal";
+}
+
+string Dance::indexFilename() const {
+	return _filename + ".index";
+}
+/*
+ *	The index is a binary file:
+ *
+ *		"SiMx" version fileBytes fileStamp levelName count
+ *		count entries of: offset length created modified lastChecked textHash status level comment createdWith
+ *
+ *	Numbers are written as __int64 or int in machine order, strings as an int length
+ *	followed by the bytes.  fileBytes and fileStamp describe the dance file as it was
+ *	written, so an index left behind by an edit outside the program is ignored.
+ */
+static const char indexMagic[4] = { 'S', 'i', 'M', 'x' };
+
+void writeBinaryString(FILE* fp, const string& s) {
+	int length = s.size();
+	fwrite(&length, sizeof length, 1, fp);
+	fwrite(s.c_str(), 1, length, fp);
+}
+
+bool readBinaryString(FILE* fp, string* s) {
+	int length;
+	if (fread(&length, sizeof length, 1, fp) != 1 || length < 0)
+		return false;
+	char* buffer = new char[length + 1];
+	bool result = int(fread(buffer, 1, length, fp)) == length;
+	buffer[length] = 0;
+	*s = buffer;
+	delete [] buffer;
+	return result;
+}
+
+template<class T>
+static bool readIndexValue(FILE* fp, T* value) {
+	return fread(value, sizeof (T), 1, fp) == 1;
+}
+
+bool Dance::writeIndex(const vector<__int64>& offsets, const vector<int>& lengths) const {
+	FILE* dnc = fileSystem::openTextFile(_filename);
+	if (dnc == null)
+		return false;
+	__int64 stamp = fileSystem::lastModified(dnc).value();
+	fclose(dnc);
+	FILE* fp = fopen(indexFilename().c_str(), "wb");
+	if (fp == null)
+		return false;
+	int version = DANCE_INDEX_VERSION;
+	int count = _sequences.size();
+	fwrite(indexMagic, 1, sizeof indexMagic, fp);
+	fwrite(&version, sizeof version, 1, fp);
+	fwrite(&_fileBytes, sizeof _fileBytes, 1, fp);
+	fwrite(&stamp, sizeof stamp, 1, fp);
+	writeBinaryString(fp, levels[_level]);
+	fwrite(&count, sizeof count, 1, fp);
+	for (int i = 0; i < count; i++) {
+		const Sequence* s = _sequences[i];
+		__int64 created = s->created;
+		__int64 modified = s->modified;
+		__int64 lastChecked = s->lastChecked().value();
+		unsigned __int64 textHash = s->textHash();
+		int status = s->status;
+		fwrite(&offsets[i], sizeof offsets[i], 1, fp);
+		fwrite(&lengths[i], sizeof lengths[i], 1, fp);
+		fwrite(&created, sizeof created, 1, fp);
+		fwrite(&modified, sizeof modified, 1, fp);
+		fwrite(&lastChecked, sizeof lastChecked, 1, fp);
+		fwrite(&textHash, sizeof textHash, 1, fp);
+		fwrite(&status, sizeof status, 1, fp);
+		writeBinaryString(fp, levels[s->level()]);
+		writeBinaryString(fp, s->comment);
+		writeBinaryString(fp, s->createdWith);
+	}
+	bool result = ferror(fp) == 0;
+	if (fclose(fp) != 0)
+		result = false;
+	return result;
+}
+
+bool Dance::readIndex() {
+	timing::Timer t("Dance::readIndex");
+	FILE* dnc = fileSystem::openTextFile(_filename);
+	if (dnc == null)
+		return false;
+	__int64 stamp = fileSystem::lastModified(dnc).value();
+	fseek(dnc, 0, SEEK_END);
+	__int64 fileBytes = ftell(dnc);
+	fclose(dnc);
+
+	FILE* fp = fopen(indexFilename().c_str(), "rb");
+	if (fp == null)
+		return false;
+	char magic[sizeof indexMagic];
+	int version;
+	__int64 indexedBytes;
+	__int64 indexedStamp;
+	string levelName;
+	int count;
+	if (fread(magic, 1, sizeof magic, fp) != sizeof magic ||
+		memcmp(magic, indexMagic, sizeof magic) != 0 ||
+		!readIndexValue(fp, &version) ||
+		version != DANCE_INDEX_VERSION ||
+		!readIndexValue(fp, &indexedBytes) ||
+		!readIndexValue(fp, &indexedStamp) ||
+		indexedBytes != fileBytes ||
+		indexedStamp != stamp ||
+		!readBinaryString(fp, &levelName) ||
+		!readIndexValue(fp, &count)) {
+		fclose(fp);
+		return false;
+	}
+	vector<Sequence*> sequences;
+	bool result = true;
+	for (int i = 0; i < count; i++) {
+		__int64 offset, created, modified, lastChecked;
+		unsigned __int64 textHash;
+		int length, status;
+		string level, comment, createdWith;
+		if (!readIndexValue(fp, &offset) ||
+			!readIndexValue(fp, &length) ||
+			!readIndexValue(fp, &created) ||
+			!readIndexValue(fp, &modified) ||
+			!readIndexValue(fp, &lastChecked) ||
+			!readIndexValue(fp, &textHash) ||
+			!readIndexValue(fp, &status) ||
+			!readBinaryString(fp, &level) ||
+			!readBinaryString(fp, &comment) ||
+			!readBinaryString(fp, &createdWith)) {
+			result = false;
+			break;
+		}
+		Sequence* s = new Sequence(this);
+		fileSystem::TimeStamp t;
+
+		s->setLevelName(level);
+		s->created = created;
+		s->modified = modified;
+		t.setValue(lastChecked);
+		s->setLastChecked(t);
+		s->status = (SequenceStatus)status;
+		s->comment = comment;
+		s->createdWith = createdWith;
+		s->setLocation(offset, length);
+		s->setTextHash(textHash);
+		sequences.push_back(s);
+	}
+	fclose(fp);
+	if (!result) {
+		sequences.deleteAll();
+		return false;
+	}
+	_levelName = levelName;
+	_level = *levelValues.get(_levelName);
+	for (int i = 0; i < sequences.size(); i++)
+		_sequences.push_back(sequences[i]);
+	_fileBytes = fileBytes;
+	return true;
+}
+
+bool Dance::readCalls(__int64 offset, int length, vector<string>* text, vector<string>* notes) const {
+	FILE* fp = fileSystem::openTextFile(_filename);
+	if (fp == null)
+		return false;
+	char* buffer = new char[length + 1];
+	fseek(fp, long(offset), SEEK_SET);
+	int n = int(fread(buffer, 1, length, fp));
 	fclose(fp);
-	return ferror(fp) == 0;
+	buffer[n] = 0;
+	bool result = n > 0 && buffer[0] == 'S';
+
+	// The sequence starts with its 'S' record and ends before the next one.
+
+	char* record = buffer;
+	for (int line = 0; result && record < buffer + n; line++) {
+		char* eol = strchr(record, '\n');
+		if (eol)
+			*eol = 0;
+		else
+			eol = buffer + n;
+		char* end = eol;
+		if (end > record && end[-1] == '\r')
+			*--end = 0;
+		if (line > 0 && record[0] == 'S')
+			break;
+		if (record[0] == '.')
+			text->push_back(string(record + 1));
+		else if (record[0] == '#') {
+			string s;
+
+			if (!string(record + 1).unescapeC(&s))
+				result = false;
+			notes->push_back(s);
+		}
+		record = eol + 1;
+	}
+	delete [] buffer;
+	return result;
 }
 
 void Dance::print() {
@@ -840,6 +1369,20 @@ const Dancer* Dancer::forwardVeer(int amount, int veer, int rightQuarterTurns, I
 	return new Dancer(newX, newY, quarterRight(facing, rightQuarterTurns), gender, couple, _dancerIndex);
 }
 
+const Dancer* Dancer::passRightShoulders(int amount, Interval* interval, Context* context) const {
+	int deltaX, deltaY;
+	int rightX, rightY;
+
+	displace(amount, 0, &deltaX, &deltaY);
+	displace(0, 1, &rightX, &rightY);
+	float halfX = deltaX / 2.0f + rightX * PASSING_SIDESTEP;
+	float halfY = deltaY / 2.0f + rightY * PASSING_SIDESTEP;
+	beats half = abs(amount) / 2;
+	interval->displace(this, x, y, halfX, halfY, 0, 0, half, context);
+	interval->displace(this, x + halfX, y + halfY, deltaX - halfX, deltaY - halfY, 0, 0, half, context);
+	return new Dancer(x + deltaX, y + deltaY, facing, gender, couple, _dancerIndex);
+}
+
 const Dancer* Dancer::face(int amount, Interval* interval, Context* context) const {
 	Facing newFacing;
 
@@ -1850,6 +2393,11 @@ bool loadLevels() {
 	return true;
 }
 
+int RandomNumbers::next(int range) {
+	_state = _state * 6364136223846793005 + 1442695040888963407;
+	return int((_state >> 33) % unsigned(range));
+}
+
 // This assumes a->y >= b->y (which would be true if a and b were taken
 // from a Group object in their index order).
 bool Rectangle::isBetween(const Dancer* a, const Dancer* b) const {
@@ -1959,20 +2507,20 @@ void Plane::print(int indent) const {
 }
 
 __int64 parseLongLong(const string& s, int offset) {
-	__int64 value = 0;
 	if (offset >= s.size())
 		return 0;
+	return parseLongLong(s.c_str() + offset);
+}
+
+__int64 parseLongLong(const char* s) {
+	__int64 value = 0;
 	bool negate = false;
-	if (s[offset] == '-') {
+	if (*s == '-') {
 		negate = true;
-		offset++;
-	}
-	for (int i = offset; i < s.size(); i++) {
-		if (isdigit(s[i]))
-			value = value * 10 + (s[i] - '0');
-		else
-			break;
+		s++;
 	}
+	for (; isdigit(*s); s++)
+		value = value * 10 + (*s - '0');
 	if (negate)
 		value = -value;
 	return value;
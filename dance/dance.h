@@ -26,6 +26,7 @@ class PrimitiveStep;
 class Stage;
 class Step;
 class Term;
+class TermPool;
 class Tile;
 class TileSearch;
 class Variant;
@@ -52,6 +53,23 @@ extern bool verboseBreathing;
 extern bool verboseParsing;
 extern bool verboseMatching;
 extern bool showUI;
+extern bool leanStages;				// prune each stage's plan tree once its motions are collected
+extern bool exploitSymmetry;		// search only half the tilings of a 180 degree symmetric group
+extern bool tabulateOutcomes;		// in call searches, apply recorded outcomes of calls that depend only on the dancers' shape
+extern string renderFolder;			// without a UI, render the named dance files' animation frames here
+extern string flowReportFile;		// without a UI, write a body-flow report on the named dance files here
+extern string sdCheckFile;			// without a UI, check the named sd transcripts a sequence at a time, writing the results here
+extern string coverageFile;			// without a UI, write the variant coverage of the named dance files here
+extern string benchmarkFile;		// without a UI, time checking the named dance files, writing JSON results here
+extern string benchmarkBaseline;	// earlier benchmark results to flag regressions against
+extern int benchmarkRuns;
+extern int benchmarkScale;			// times each dance's sequences are repeated for the benchmark
+extern string microBenchmarkFile;	// without a UI, time the engine's pieces on generated inputs, writing JSON results here
+extern string microBenchmarkBaseline;
+extern string generateFile;			// without a UI, write generateCount random sequences at generateLevel to this .dnc file
+extern string generateLevel;
+extern int generateCount;
+extern unsigned generateSeed;		// 0 seeds the generator from the clock; the summary line prints the seed used
 
 bool anyVerbose();
 
@@ -60,6 +78,8 @@ void clearMemory();
 
 const int MAX_DANCERS = 12;
 
+const int ZOBRIST_VARIANTS = 8;			// 4 quarter-turn rotations, with and without a mirror
+
 const double PI = 3.14159;
 
 Facing mirrorFacing(Facing facing);
@@ -71,6 +91,13 @@ Facing quarterRight(Facing facing, int amount);
 Facing reverse(Facing facing);
 
 bool ambiguous(Facing facing);
+/*
+ *	facingToAngles
+ *
+ *	Converts a facing into the nose angle(s) used to draw a dancer.  Ambiguous
+ *	facings get a second nose, and ANY_FACING gets none (NO_NOSE).
+ */
+void facingToAngles(Facing facing, double* noseAngle, double* secondNoseAngle);
 
 enum Direction {
 	D_AS_YOU_ARE,
@@ -231,6 +258,29 @@ enum Primitives {
 	P_PRIMITIVE_COUNT
 };
 
+/*
+ *	RandomNumbers
+ *
+ *	A 64-bit linear congruential generator.  A given seed always yields the same
+ *	numbers, on any platform, so that generated sequences and benchmark inputs can
+ *	be repeated.
+ */
+class RandomNumbers {
+public:
+	RandomNumbers(unsigned seed) {
+		_state = seed;
+	}
+	/*
+	 *	next
+	 *
+	 *	Returns a number from 0 up to, but not including, range.
+	 */
+	int next(int range);
+
+private:
+	unsigned __int64	_state;
+};
+
 class Rectangle {
 public:
 	Rectangle() {}
@@ -285,7 +335,10 @@ public:
 
 class Plane {
 public:
-	Plane(int tile, const Tile* owner, int afterWidth, Plane* lesserEdge, Plane* greaterEdge) {
+	Plane() {
+	}
+
+	void setCenter(int tile, const Tile* owner, int afterWidth, Plane* lesserEdge, Plane* greaterEdge) {
 		this->before = (lesserEdge->before + greaterEdge->before) / 2;
 		this->now = (lesserEdge->now + greaterEdge->now) / 2;
 		this->after = INT_MAX;
@@ -302,7 +355,7 @@ public:
 		lesserEdge->lesser = true;
 	}
 
-	Plane(int edge, int nowEdge, int tile, const Tile* owner) {
+	void setEdge(int edge, int nowEdge, int tile, const Tile* owner) {
 		this->before = edge;
 		this->now = nowEdge;
 		this->after = INT_MAX;
@@ -316,7 +369,7 @@ public:
 		this->centerLine = false;
 	}
 
-	Plane(bool centerLine) {
+	void setCenterLine() {
 		this->before = 0;
 		this->now = 0;
 		this->after = 0;
@@ -327,7 +380,7 @@ public:
 		this->afterWidth = 0;
 		this->lesser = false;
 		this->tileCenter = null;
-		this->centerLine = centerLine;
+		this->centerLine = true;
 	}
 
 	int before;								// coordinate of this plane before the call
@@ -482,6 +535,7 @@ private:
 
 class Integer : public Term {
 	friend Stage;
+	friend TermPool;
 public:
 	int value() const { return _value; }
 
@@ -513,6 +567,7 @@ private:
 
 class Fraction : public Term {
 	friend Stage;
+	friend TermPool;
 public:
 	/*
 	 *	improperNumerator
@@ -640,6 +695,7 @@ private:
 
 class Anyone : public Term {
 	friend Stage;
+	friend TermPool;
 	friend Grammar;
 public:
 	unsigned match(const Group* dancers, const Step* step, Context* context) const;
@@ -812,6 +868,33 @@ private:
 	int		_y0, _y1, _y2;
 	bool	_allocated;
 };
+/*
+ *	Symmetry
+ *
+ *	One of the ways a group can be turned into an equivalent one: an optional left-right
+ *	mirror, then some left quarter turns about the local origin, with every couple number
+ *	advanced around the square.  An odd couple shift trades the heads for the sides.
+ */
+class Symmetry {
+public:
+	Symmetry() {
+		mirrored = false;
+		leftQuarterTurns = 0;
+		coupleShift = 0;
+	}
+
+	Symmetry(bool mirrored, int leftQuarterTurns, int coupleShift) {
+		this->mirrored = mirrored;
+		this->leftQuarterTurns = leftQuarterTurns;
+		this->coupleShift = coupleShift;
+	}
+
+	bool	mirrored;
+	int		leftQuarterTurns;	// 0-3
+	int		coupleShift;		// 0-3, added to each couple number, wrapping from 4 to 1
+};
+
+const int COUPLE_SHIFTS = 4;
 
 const int NO_NOSE = 1000000;		// value used to indicate no nose angle in dancer drawings.
 
@@ -870,6 +953,14 @@ public:
 	const Dancer* arc(Geometry geometry, Point center, double radius, int rightSixteenthTurns, double angleAdjust, int noseQuarterTurns, Interval* interval, Context* context) const;
 
 	const Dancer* forwardVeer(int amount, int veer, int rightQuarterTurns, Interval* interval, Context* context) const;
+	/*
+	 *	passRightShoulders
+	 *
+	 *	Moves the dancer forward as forwardVeer does, but draws the motion bearing
+	 *	right to the halfway point and back, so that two dancers walking through each
+	 *	other face to face pass right shoulders.
+	 */
+	const Dancer* passRightShoulders(int amount, Interval* interval, Context* context) const;
 
 	const Dancer* face(int amount, Interval* interval, Context* context) const;
 
@@ -1058,6 +1149,13 @@ public:
 	bool hasAmbiguousFacing() const;
 
 	bool isSymmetric(const Sequence* sequence) const;
+	/*
+	 *	oppositeMask
+	 *
+	 *	For a symmetric group, maps each dancer in the mask to the dancer
+	 *	opposite it.
+	 */
+	unsigned oppositeMask(unsigned mask) const;
 
 	const Group* disambiguateFromRoot(Context* context) const;
 
@@ -1224,10 +1322,91 @@ public:
 	void setTiled() { _tiled = true; }
 
 	bool tiled() const { return _tiled; }
+	/*
+	 *	hash
+	 *
+	 *	This is a Zobrist hash of the (dancerIndex, x, y, facing) of each dancer,
+	 *	in the local coordinates of this group.  It is computed on first use.  After
+	 *	that, groups derived by forwardVeer, arc, face, run and roll carry the value
+	 *	forward, folding in only the dancers that changed.
+	 *
+	 *	Do not call this until the group is fully populated.
+	 */
+	unsigned __int64 hash() const;
+	// Test API
+	/*
+	 *	hashesCurrent
+	 *
+	 *	Recomputes the hashes from the dancers.  False if hashes were being carried
+	 *	forward and did not agree with them.
+	 */
+	bool hashesCurrent() const;
+	/*
+	 *	rotationInvariantHash
+	 *
+	 *	Two groups that differ only by a quarter-turn rotation about the local
+	 *	origin produce the same value.
+	 */
+	unsigned __int64 rotationInvariantHash() const;
+	/*
+	 *	mirrorInvariantHash
+	 *
+	 *	As rotationInvariantHash, but also insensitive to a left-right mirror.
+	 */
+	unsigned __int64 mirrorInvariantHash() const;
+	/*
+	 *	canonicalHash
+	 *
+	 *	The least hash over every Symmetry of the group: 4 rotations, with or without a
+	 *	mirror, times 4 couple shifts.  Two groups that are the same up to symmetry give
+	 *	the same value, provided they also have the same geometry and rotation (which is
+	 *	not hashed).  If symmetry is not null, it receives the transform that produced
+	 *	the value.
+	 *
+	 *	A group that is not on a grid, or has couples beyond 4, is only relabelled, or
+	 *	not transformed at all.
+	 */
+	unsigned __int64 canonicalHash(bool mirrors, Symmetry* symmetry) const;
+	/*
+	 *	canonicalHash
+	 *
+	 *	As above, but the least hash over only the count listed symmetries, for a
+	 *	search whose calls mean the same under some symmetries and not others.  A
+	 *	symmetry the group cannot take, as above, is skipped.
+	 */
+	unsigned __int64 canonicalHash(const Symmetry* symmetries, int count, Symmetry* symmetry) const;
+	/*
+	 *	hash
+	 *
+	 *	The hash() the group would have once transformed by the symmetry, without
+	 *	building it.
+	 */
+	unsigned __int64 hash(const Symmetry& symmetry) const;
+	/*
+	 *	canonical
+	 *
+	 *	Returns the representative group for this one: the group transformed by the
+	 *	symmetry canonicalHash chooses, whose hash() is the canonicalHash.  The result
+	 *	keeps the rotation and geometry, but has no base or transform.
+	 */
+	Group* canonical(bool mirrors, Symmetry* symmetry, Context* context) const;
+
+	Group* applySymmetry(const Symmetry& symmetry, Context* context) const;
 
 private:
 
 	int buildPhantom4Dancer(const VariantTile& tile, TileSearch* out, Context* context, const Anything* call, Step* step) const;
+	/*
+	 *	searchTiling
+	 *
+	 *	Tries tiles starting from each of the first startingDancers dancers of the group,
+	 *	and returns the best tiling found.
+	 */
+	int searchTiling(const vector<VariantTile>& tiles, TileSearch* out, Context* context, const Anything* call, Step* step, TileAction tileAction, int startingDancers) const;
+
+	bool symmetricDesignators(const Anything* call, const Step* step, Context* context) const;
+
+	bool symmetricTiling(const TileSearch* tiling, int count) const;
 
 	static int compare(const void* ts1, const void* ts2);
 
@@ -1240,6 +1419,7 @@ private:
 		_transform = null;
 		_base = base;
 		_tiled = false;
+		_hashed = false;
 	}
 
 	Group(Geometry geometry) : Term(string()) {
@@ -1249,10 +1429,17 @@ private:
 		_transform = null;
 		_base = null;
 		_tiled = false;
+		_hashed = false;
 	}
 
 	static Group* makeHome();
 
+	void computeHashes() const;
+
+	void carryHashes(const Group* source);
+
+	void rehash(const Dancer* before, const Dancer* after);
+
 	vector<const Dancer*>	_dancers;
 	Geometry				_geometry;
 	Geometry				_homeGeometry;
@@ -1260,6 +1447,8 @@ private:
 	bool					_tiled;
 	const Transform*		_transform;
 	const Group*			_base;
+	mutable bool			_hashed;
+	mutable unsigned __int64 _hashes[ZOBRIST_VARIANTS];	// indexed by left quarter turns, + 4 if mirrored
 };
 
 Rotation rotateBy(int n);
@@ -1284,6 +1473,16 @@ bool loadLevels();
 
 __int64 parseLongLong(const string& s, int offset);
 
+__int64 parseLongLong(const char* s);
+/*
+ *	writeBinaryString
+ *
+ *	Strings in the binary sidecar files are an int length followed by the bytes.
+ */
+void writeBinaryString(FILE* fp, const string& s);
+
+bool readBinaryString(FILE* fp, string* s);
+
 Gender gender(PositionType position);
 
 }  // namespace dance
@@ -154,11 +154,12 @@ bool DanceEditor::save() {
 			_dance->setFilename(buffer);
 		}
 	}
-	if (!fileSystem::createBackupFile(_dance->filename())) {
+	if (_dance->needsCompaction() &&
+		!fileSystem::createBackupFile(_dance->filename())) {
 		_frame->setStatus("Could not create backup for " + _dance->filename());
 		return false;
 	}
-	if (_dance->save()) {
+	if (_dance->saveChanges()) {
 		_frame->setStatus(_dance->label() + " saved to " + _dance->filename());
 		tabModified();
 		_undoStack.markSavedState();
@@ -378,6 +379,7 @@ void DanceEditor::donePrinting() {
 }
 
 void DanceEditor::touch(Sequence* sequence) {
+	_dance->touch(sequence);
 	for (int i = 0; i < _sequenceMap.size(); i++)
 		if (_sequenceMap[i].sequence == sequence) {
 			_sequenceMap[i].comment->set_value(sequence->comment);
@@ -474,6 +476,7 @@ void DanceEditor::onAddSequence(display::MouseKeys mKeys, display::point p, disp
 	Sequence* sequence = _dance->newSequence();
 	string levelName = getPreference("defaultLevel");
 	sequence->setLevelName(levelName);
+	_dance->touch(sequence);
 	_sequenceArea->reopen(-1, -1);
 		showSequenceInfo(_sequenceMap.size(), sequence);
 	_sequenceArea->complete();
@@ -5,12 +5,17 @@
 #include "../common/file_system.h"
 #include "../common/parser.h"
 #include "../engine/global.h"
-#include "../sd/sd.h"
 #include "../test/test.h"
 #include "call.h"
+#include "coverage.h"
+#include "modules.h"
+#include "resolve.h"
+#include "sd_stream.h"
 
 namespace dance {
 
+static Stage* performCall(Sequence* seq, const Grammar* g, const Group* dancers, const string& call);
+
 class TransformObject : public script::Object {
 public:
 	static script::Object* factory() {
@@ -384,7 +389,7 @@ private:
 			if (a != null) {
 				string expectedFinalPartial = a->toString();
 				Context context(null, g);
-				Stage tempStorage(null, null);
+				Stage tempStorage(null, null, g->termPool());
 				context.startStage(&tempStorage);
 				vector<Token> tokens;
 				Token finalPartial;
@@ -540,6 +545,30 @@ public:
 	}
 
 private:
+	/*
+	 *	CoverCheck
+	 *
+	 *	Counts the variants each sequence of an sd transcript applied while it is
+	 *	checked, before its stages are deleted.
+	 */
+	class CoverCheck : public SdCheck {
+	public:
+		CoverCheck(const Grammar* grammar, bool allowUnresolved, VariantCoverage* coverage) : SdCheck(grammar, allowUnresolved) {
+			_coverage = coverage;
+		}
+
+		virtual void checked(Sequence* sequence, int index) {
+			if (_coverage == null)
+				return;
+			const vector<const Stage*>& stages = sequence->stages();
+			for (int k = 0; k < stages.size(); k++)
+				_coverage->add(stages[k]);
+		}
+
+	private:
+		VariantCoverage*	_coverage;
+	};
+
 	DanceObject() {
 		_localGrammar = null;
 	}
@@ -573,7 +602,7 @@ private:
 		}
 		bool result = true;
 		int reportCoverLevel = -1;
-		dictionary<int> variantMap;
+		VariantCoverage coverage;
 		script::Atom* a = get("cover");
 		if (a) {
 			bool matchedOne = false;
@@ -590,25 +619,6 @@ private:
 							printf(" *** Definition %s has no variants.\n", def->label().c_str());
 							result = false;
 						}
-						for (int k = 0; k < vars.size(); k++) {
-							if (vars[k]->effectiveLevel() != i)
-								continue;
-							string s;
-							void* buffer = s.buffer_(sizeof (VariantTile));
-							if (vars[k]->patterns().size() == 0) {
-								VariantTile vt(vars[k], null);
-								memcpy(buffer, &vt, sizeof vt);
-								variantMap.insert(s, 0);
-							} else {
-								Variant* v = vars[k];
-								for (int m = 0; m < v->recognizers().size(); m++) {
-									VariantTile vt(v, v->recognizers()[m]);
-									memcpy(buffer, &vt, sizeof vt);
-									vt.pattern = null;
-									variantMap.insert(s, 0);
-								}
-							}
-						}
 					}
 				}
 			}
@@ -617,17 +627,30 @@ private:
 				return false;
 			}
 		}
-		Dance* d;
-		if (_path.tolower().endsWith(".dnc")) {
-			d = new Dance(_path, _path);
-			if (!d->read()) {
-				printf("Errors in file, contents might be corrupted: %s\n", _path.c_str());
+		if (!_path.tolower().endsWith(".dnc")) {
+			// sd transcripts can hold tens of thousands of sequences, so each one is
+			// checked as it is read instead of loading the whole file into a Dance.
+
+			g->compileStateMachines();
+			CoverCheck check(g, get("allowUnresolved") != null, reportCoverLevel >= 0 ? &coverage : null);
+			if (!check.check(_path, stdout)) {
+				printf("Can't load file %s\n", _path.c_str());
 				return false;
 			}
-		} else
-			d = parseSdFile(_path);
-		if (d == null) {
-			printf("Can't load file %s\n", _path.c_str());
+			if (check.failedSequences) {
+				printf("Some sequence failed to resolve\n");
+				result = false;
+			}
+			check.writeTotals(stdout, _path);
+			if (reportCoverLevel >= 0 && coverage.write(stdout, g, (Level)reportCoverLevel) > 0)
+				result = false;
+			if (!result)
+				return false;
+			return runAnyContent();
+		}
+		Dance* d = new Dance(_path, _path);
+		if (!d->read()) {
+			printf("Errors in file, contents might be corrupted: %s\n", _path.c_str());
 			return false;
 		}
 		g->compileStateMachines();
@@ -636,6 +659,11 @@ private:
 			printf("Some sequence failed to resolve\n");
 			result = false;
 		}
+		if (get("compareSymmetry")) {
+			for (int j = 0; j < d->sequences().size(); j++)
+				if (!compareSymmetry(d->sequences()[j], j, g))
+					result = false;
+		}
 		int calls = 0;
 		int failedCalls = 0;
 		int resolvedSequences = 0;
@@ -651,120 +679,934 @@ private:
 				resolvedSequences++;
 		}
 		printf("%s\n   Total sequences %d (resolved %d %0.1f%%) / calls %d (passed %d %0.1f%%)\n", _path.c_str(), seqs.size(), resolvedSequences, (100.0 * resolvedSequences) / seqs.size(), calls, calls - failedCalls, (100.0 * (calls - failedCalls)) / calls);
-		if (reportCoverLevel >= 0) {
-			for (int j = 0; j < seqs.size(); j++) {
-				Sequence* seq = seqs[j];
-				const vector<const Stage*>& stages = seq->stages();
-				for (int k = 0; k < stages.size(); k++) {
-					const Stage* s = stages[k];
-					if (s->failed())
-						continue;
-					if (verboseOutput)
-						printf("Try seq %d / %d:\n", j, k);
-					explore(stages[k], variantMap);
-				}
-			}
-			int uncovered = 0;
-			int covered = 0;
-			dictionary<int>::iterator i = variantMap.begin();
-			while (i.valid()) {
-				const string& key = i.key();
-				VariantTile* vt = (VariantTile*)&key[0];
-				int value = *i;
-				if (verboseOutput)
-					printf("%5d: %s / %s\n", value, vt->variant->definition()->label().c_str(), vt->pattern ? vt->pattern->formation()->name().c_str() : "<default>");
-				if (value == 0) {
-					printf(" *** Uncovered: %s / %s%c\n", vt->variant->definition()->label().c_str(), vt->pattern ? vt->pattern->formation()->name().c_str() : (vt->variant->patterns().size() ? vt->variant->patterns()[0].c_str() : "<default>"),
-						vt->pattern || vt->variant->patterns().size() == 0 ? ' ' : '*');
-					uncovered++;
-				} else
-					covered++;
-				i.next();
-			}
-			if (uncovered > 0) {
-				printf("Total %d uncovered variants / %d covered (%d total %0.1f%%)\n", uncovered, covered, uncovered + covered, 100 * covered / (double)(covered + uncovered));
-				result = false;
-			} else
-				printf("All %d variants covered (100%%)\n", covered);
-		}
 		for (int j = 0; j < seqs.size(); j++) {
 			Sequence* seq = seqs[j];
 			seq->clearStages();
 		}
 		delete d;
+		if (reportCoverLevel >= 0 && !checkCover(g, (Level)reportCoverLevel))
+			result = false;
 		if (!result)
 			return false;
 		return runAnyContent();
 	}
 
-	void explore(const Plan* p, dictionary<int>& variantMap) {
-		if (!exploreCheck(p, variantMap))
-			return;
-		for (int i = 0; i < p->stepCount(); i++) {
-			if (verboseOutput)
-				printf("Step %d:\n", i);
-			Step* step = p->step(i);
-			for (int j = 0; j < step->collapsed().size(); j++)
-				exploreCheck(step->collapsed()[j], variantMap);
-			const vector<Tile*>& tiles = step->tiles();
-			for (int j = 0; j < tiles.size(); j++) {
-				if (verboseOutput)
-					printf("Tile %d:\n", j);
-				explore(tiles[j]->plan(), variantMap);
+	/*
+	 *	compareSymmetry
+	 *
+	 *	Performs each call of the sequence again with exploitSymmetry flipped, and
+	 *	checks that the half search of symmetric groups chose the same tilings, by the
+	 *	dancers they leave.
+	 */
+	bool compareSymmetry(Sequence* seq, int index, const Grammar* g) {
+		bool saved = exploitSymmetry;
+		exploitSymmetry = !saved;
+		bool result = true;
+		const vector<const Stage*>& stages = seq->stages();
+		for (int k = 0; k < stages.size(); k++) {
+			if (stages[k]->call() == null)
+				continue;
+			Context context(seq, g);
+			Stage* replay = new Stage(seq, stages[k]->start(), g->termPool());
+			context.startStage(replay);
+			replay->setCall(stages[k]->call());
+			replay->perform(null, &context, TILE_ALL);
+			replay->breathe(&context);
+			context.endStage();
+			bool same;
+			if (replay->failed() || stages[k]->failed())
+				same = replay->failed() == stages[k]->failed();
+			else
+				same = replay->final() != null && stages[k]->final() != null &&
+					   replay->final()->equals(stages[k]->final());
+			if (!same) {
+				printf(" *** Sequence %d call %d '%s' differs with exploitSymmetry %s\n", index + 1, k + 1, k < seq->text().size() ? seq->text()[k].c_str() : "", saved ? "off" : "on");
+				result = false;
 			}
+			delete replay;
 		}
+		exploitSymmetry = saved;
+		return result;
 	}
 
-	bool exploreCheck(const Plan* p, dictionary<int>& variantMap) {
-		if (p->applied()) {
-			const Variant* v = p->applied();
-			const Pattern* pattern = p->matched();
+	/*
+	 *	checkCover
+	 *
+	 *	Covers the dance twice through its stage cache: first with no .stages file, so
+	 *	every sequence is performed, then again from the file the first pass saved, so
+	 *	none is.  Both passes must count every variant the same.  The variants at the
+	 *	level that were never applied are reported.
+	 */
+	bool checkCover(const Grammar* g, Level level) {
+		bool result = true;
+		string stagesFile = _path + ".stages";
+		remove(stagesFile.c_str());
+		VariantCoverage cold;
+		if (!cold.cover(_path, g)) {
+			printf("Errors in file, contents might be corrupted: %s\n", _path.c_str());
+			return false;
+		}
+		if (cold.performed() != cold.sequences()) {
+			printf(" *** Performed %d of %d sequences with no stage cache\n", cold.performed(), cold.sequences());
+			result = false;
+		}
+		if (!fileSystem::exists(stagesFile)) {
+			printf(" *** Covering did not save %s\n", stagesFile.c_str());
+			result = false;
+		}
+		VariantCoverage warm;
+		warm.cover(_path, g);
+		if (warm.performed() != 0) {
+			printf(" *** Performed %d of %d sequences with a valid stage cache\n", warm.performed(), warm.sequences());
+			result = false;
+		}
+		for (const Grammar* gr = g; gr; gr = gr->backupGrammar()) {
+			const vector<Definition*>& defs = gr->definitions();
+			for (int i = 0; i < defs.size(); i++) {
+				const vector<Variant*>& vars = defs[i]->variants();
+				for (int j = 0; j < vars.size(); j++) {
+					const Variant* v = vars[j];
+					int patterns = v->recognizers().size();
+					for (int k = 0; k < patterns || k == 0; k++) {
+						string key = VariantCoverage::key(v, k < patterns ? v->recognizers()[k] : null);
+						if (cold.count(key) != warm.count(key)) {
+							printf(" *** %s counted %d times performed, %d from the stage cache\n", key.c_str(), cold.count(key), warm.count(key));
+							result = false;
+						}
+					}
+				}
+			}
+		}
+		if (warm.write(stdout, g, level) > 0)
+			result = false;
+		remove(stagesFile.c_str());
+		return result;
+	}
 
-			VariantTile vt(v, pattern);
+private:
+	string _path;
+	Grammar* _localGrammar;
+};
 
-			if (verboseOutput) {
-				printf("probe %s ", v->definition()->label().c_str());
-				if (v->patterns().size())
-					printf("%s", v->patterns()[0].c_str());
-				else
-					printf("<none>");
-				printf("/");
-				if (pattern)
-					printf("%s:%s", pattern->formation()->name().c_str(), pattern->parameterList().c_str());
+/*
+ *	SdReadObject
+ *
+ *	Reads a small sd transcript with SdReader and checks the calls and level of
+ *	each sequence.  The transcript has a call wrapped onto a second line, a
+ *	picture and a warning between calls, a bare form feed between sequences and
+ *	A1 and C3A header lines.
+ */
+class SdReadObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new SdReadObject();
+	}
+
+private:
+	SdReadObject() {}
+
+	virtual bool validate(script::Parser* parser) {
+		return true;
+	}
+
+	virtual bool run() {
+		static const char transcript[] =
+			"Sd38.70:db38.70     Sat Apr  4 20:06:31 2009     A1\n"
+			"\n"
+			"  1: heads square thru 4\n"
+			"  2: swing thru, chain reaction but\n"
+			"        cast 3/4 instead\n"
+			"\n"
+			"   1B>  2GV  3B<\n"
+			"Warning:  Do your part.\n"
+			"  3: right and left grand\n"
+			"    1B^  1GV  2B<\n"
+			"\f\n"
+			"  1: heads star thru\n"
+			"\fSd38.70:db38.70     Sat Apr  4 20:06:31 2009     C3A\n"
+			"\n"
+			"  1: sides pass the ocean\n"
+			"  2: extend\n";
+		static const char* expected[] = {
+			"heads square thru 4",
+			"swing thru, chain reaction but cast 3/4 instead",
+			"right and left grand",
+			null,
+			"heads star thru",
+			null,
+			"sides pass the ocean",
+			"extend",
+			null
+		};
+		static const char* levelNames[] = { "Advanced-1", "Advanced-1", "Challenge-3A" };
+
+		FILE* fp = tmpfile();
+		if (fp == null) {
+			printf("Could not create a temporary file\n");
+			return false;
+		}
+		fputs(transcript, fp);
+		rewind(fp);
+		SdReader reader("transcript", null);
+		if (!reader.open(fp))
+			return false;
+		bool result = true;
+		int e = 0;
+		for (int i = 0; i < dimOf(levelNames); i++) {
+			Sequence* s = reader.next();
+			if (s == null) {
+				printf(" *** Sequence %d missing\n", i + 1);
+				return false;
+			}
+			if (s->level() != *levelValues.get(levelNames[i])) {
+				printf(" *** Sequence %d has level %s, expected %s\n", i + 1, levels[s->level()].c_str(), levelNames[i]);
+				result = false;
+			}
+			const vector<string>& text = s->text();
+			int j;
+			for (j = 0; expected[e + j]; j++) {
+				if (j >= text.size())
+					printf(" *** Sequence %d call %d missing, expected '%s'\n", i + 1, j + 1, expected[e + j]);
+				else if (text[j] != expected[e + j])
+					printf(" *** Sequence %d call %d is '%s', expected '%s'\n", i + 1, j + 1, text[j].c_str(), expected[e + j]);
 				else
-					printf("<null>");
-				printf("\n");
-			}
-			string s;
-			void* buffer = s.buffer_(sizeof (VariantTile));
-			memcpy(buffer, &vt, sizeof vt);
-			vt.pattern = null;
-			if (variantMap.probe(s)) {
-				if (verboseOutput)
-					printf("hit!\n");
-				int* entry = variantMap.get(s);
-				(*entry)++;
-			}
-			const string& defName = v->definition()->name();
-			// These 'connective' calls don't stop us from counting
-			// their constituent parts.  Otherwise, concepts do such 
-			// extensive modification of their operands that we can't
-			// count a call under a concept as being 'covered'
-			if (defName != "transparent_")
+					continue;
+				result = false;
+			}
+			if (text.size() > j) {
+				printf(" *** Sequence %d has %d calls, expected %d\n", i + 1, text.size(), j);
+				result = false;
+			}
+			e += j + 1;
+			delete s;
+		}
+		Sequence* extra = reader.next();
+		if (extra) {
+			printf(" *** Unexpected sequence after the last one\n");
+			delete extra;
+			result = false;
+		}
+		if (reader.failed())
+			result = false;
+		if (!result)
+			return false;
+		return runAnyContent();
+	}
+};
+/*
+ *	OutcomesObject
+ *
+ *	Performs every candidate call at a level from home and from the positions the
+ *	first few candidates reach, once through the CallOutcomes table and once in
+ *	full, and checks that each applied outcome ends where the full perform does.
+ *	The table is shared across the starting positions, so an outcome recorded from
+ *	one position is also checked against the others of the same shape.
+ */
+class OutcomesObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new OutcomesObject();
+	}
+
+private:
+	class OutcomeCheck : public CallSearch {
+	public:
+		OutcomeCheck(const Grammar* grammar, Level level) : CallSearch(grammar, level) {
+		}
+
+		/*
+		 *	check
+		 *
+		 *	The first tabled perform from a new shape records its outcome, and the
+		 *	second applies it, so both ways through the table are compared.
+		 */
+		bool check(const Group* start) {
+			bool result = true;
+			for (int i = 0; i < _candidates.size(); i++) {
+				Stage* full = performFull(start, i);
+				for (int pass = 0; pass < 2; pass++) {
+					Stage* tabled = perform(start, i);
+					bool same;
+					if (full == null || tabled == null)
+						same = full == tabled;
+					else
+						same = tabled->final()->equals(full->final());
+					if (!same) {
+						printf(" *** '%s' from %s: the tabled outcome differs from a full perform\n", _candidates[i].c_str(), start == Group::home ? "home" : "a later position");
+						result = false;
+					}
+					delete tabled;
+				}
+				delete full;
+			}
+			return result;
+		}
+
+		Stage* performFull(const Group* start, int candidate) {
+			return perform(start, _candidates[candidate]);
+		}
+	};
+
+	OutcomesObject() {
+		_localGrammar = null;
+	}
+
+	~OutcomesObject() {
+		delete _localGrammar;
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		script::Atom* a = get("level");
+		if (a == null)
+			_level = levels.size() - 1;
+		else {
+			string v = a->toString();
+			for (_level = 0; _level < levels.size(); _level++)
+				if (v == levels[_level])
+					break;
+			if (_level >= levels.size()) {
+				printf("Unknown level name\n");
 				return false;
+			}
 		}
+		a = get("starts");
+		_starts = a ? a->toString().toInt() : 8;
 		return true;
 	}
 
+	virtual bool run() {
+		GrammarObject* go;
+		Grammar* g;
+		if (containedBy(&go))
+			g = go->grammar();
+		else {
+			g = new Grammar();
+			_localGrammar = g;
+			if (!g->read(global::dataFolder + "/dance/calls.cdf")) {
+				printf("Could not load default definitions\n");
+				return false;
+			}
+		}
+		g->compileStateMachines();
+		bool saved = tabulateOutcomes;
+		tabulateOutcomes = true;
+		OutcomeCheck check(g, _level);
+		bool result = check.check(Group::home);
+		vector<Stage*> starts;
+		for (int i = 0; i < check.candidates().size() && starts.size() < _starts; i++) {
+			Stage* s = check.performFull(Group::home, i);
+			if (s == null)
+				continue;
+			if (s->final()->equals(Group::home))
+				delete s;
+			else
+				starts.push_back(s);
+		}
+		for (int i = 0; i < starts.size(); i++)
+			if (!check.check(starts[i]->final()))
+				result = false;
+		starts.deleteAll();
+		tabulateOutcomes = saved;
+		if (!result)
+			return false;
+		return runAnyContent();
+	}
+
+	Level		_level;
+	int			_starts;
+	Grammar*	_localGrammar;
+};
+/*
+ *	CanonicalObject
+ *
+ *	Performs a call from home and checks the symmetry hashes of the position it
+ *	reaches.  Every image under the 32 symmetries must have the hash that
+ *	Group::hash(symmetry) predicts, and the same canonicalHash.  Home must be its
+ *	own half turn.  Every zero the ModuleFinder reports from the position must
+ *	bring the dancers back to it, including those found through a half turn, and
+ *	none may be reported twice.  A one call zero done twice is a zero that only
+ *	reaches the start after being there already, and must be reported too.
+ */
+class CanonicalObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new CanonicalObject();
+	}
+
 private:
-	string _path;
-	Grammar* _localGrammar;
+	CanonicalObject() {
+		_localGrammar = null;
+	}
+
+	~CanonicalObject() {
+		delete _localGrammar;
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		script::Atom* a = get("call");
+		_call = a ? a->toString() : "heads star thru";
+		return true;
+	}
+
+	virtual bool run() {
+		GrammarObject* go;
+		Grammar* g;
+		if (containedBy(&go))
+			g = go->grammar();
+		else {
+			g = new Grammar();
+			_localGrammar = g;
+			if (!g->read(global::dataFolder + "/dance/calls.cdf")) {
+				printf("Could not load default definitions\n");
+				return false;
+			}
+		}
+		g->compileStateMachines();
+		Sequence seq(null);
+		Stage* stage = performCall(&seq, g, Group::home, _call);
+		if (stage == null) {
+			printf(" *** '%s' does not work from home\n", _call.c_str());
+			return false;
+		}
+		const Group* start = stage->final();
+		bool result = true;
+
+		Context context(&seq, g);
+		Stage* images = new Stage(&seq, start, g->termPool());
+		context.startStage(images);
+		unsigned __int64 canonical = start->canonicalHash(true, null);
+		for (int m = 0; m < 2; m++)
+			for (int q = 0; q < 4; q++)
+				for (int s = 0; s < COUPLE_SHIFTS; s++) {
+					Symmetry symmetry(m != 0, q, s);
+					Group* image = start->applySymmetry(symmetry, &context);
+					if (image->hash() != start->hash(symmetry)) {
+						printf(" *** Symmetry %d/%d/%d: hash(symmetry) differs from the image's hash\n", m, q, s);
+						result = false;
+					}
+					if (image->canonicalHash(true, null) != canonical) {
+						printf(" *** Symmetry %d/%d/%d: the image has another canonicalHash\n", m, q, s);
+						result = false;
+					}
+				}
+		if (start->canonical(true, null, &context)->hash() != canonical) {
+			printf(" *** The canonical group's hash is not the canonicalHash\n");
+			result = false;
+		}
+		if (!Group::home->applySymmetry(Symmetry(false, 2, 2), &context)->equals(Group::home)) {
+			printf(" *** Home is not its own half turn\n");
+			result = false;
+		}
+		context.endStage();
+
+		ModuleFinder finder(g, NO_LEVEL);
+		finder.findZeros(start, 2, MODULE_MILLISECONDS);
+		const vector<CallList*>& zeros = finder.modules();
+		dictionary<int> reported;
+		for (int i = 0; i < zeros.size(); i++) {
+			const vector<string>& calls = zeros[i]->calls;
+			vector<Stage*> stages;
+			const Group* dancers = start;
+			for (int j = 0; j < calls.size() && dancers; j++) {
+				Stage* s = performCall(&seq, g, dancers, calls[j]);
+				dancers = null;
+				if (s) {
+					stages.push_back(s);
+					dancers = s->final();
+				}
+			}
+			string text;
+			for (int j = 0; j < calls.size(); j++)
+				text = text + (j ? "; " : "") + calls[j];
+			if (dancers == null || !dancers->equals(start)) {
+				printf(" *** Reported zero '%s' does not return to the start\n", text.c_str());
+				result = false;
+			}
+			stages.deleteAll();
+			int* count = reported.get(text);
+			if (++*count == 2) {
+				printf(" *** Zero '%s' is reported more than once\n", text.c_str());
+				result = false;
+			}
+		}
+		if (!finder.timedOut() && zeros.size() < MODULE_MAX_RESULTS) {
+			for (int i = 0; i < zeros.size(); i++) {
+				if (zeros[i]->calls.size() != 1)
+					continue;
+				string twice = zeros[i]->calls[0] + "; " + zeros[i]->calls[0];
+				if (*reported.get(twice) == 0) {
+					printf(" *** Zero '%s' is not reported\n", twice.c_str());
+					result = false;
+				}
+			}
+		}
+		delete images;
+		delete stage;
+		if (!result)
+			return false;
+		return runAnyContent();
+	}
+
+	string		_call;
+	Grammar*	_localGrammar;
+};
+/*
+ *	HashesObject
+ *
+ *	Performs calls from home and checks that every group of each stage, most of
+ *	them derived by forwardVeer, arc, face and merge with their hashes carried
+ *	forward, has the hashes computed afresh from its dancers.  The calls are a
+ *	';' separated list.
+ */
+class HashesObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new HashesObject();
+	}
+
+private:
+	HashesObject() {
+		_localGrammar = null;
+	}
+
+	~HashesObject() {
+		delete _localGrammar;
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		script::Atom* a = get("calls");
+		string calls = a ? a->toString() : "heads pass thru;heads star thru;face left;heads face right;circle left 1/4;heads square thru 4";
+		for (int start = 0; start < calls.size();) {
+			int end = calls.find(';', start);
+			if (end == string::npos)
+				end = calls.size();
+			_calls.push_back(calls.substr(start, end - start).trim());
+			start = end + 1;
+		}
+		return true;
+	}
+
+	virtual bool run() {
+		GrammarObject* go;
+		Grammar* g;
+		if (containedBy(&go))
+			g = go->grammar();
+		else {
+			g = new Grammar();
+			_localGrammar = g;
+			if (!g->read(global::dataFolder + "/dance/calls.cdf")) {
+				printf("Could not load default definitions\n");
+				return false;
+			}
+		}
+		g->compileStateMachines();
+		Sequence seq(null);
+		Group::home->hash();
+		bool result = true;
+		for (int i = 0; i < _calls.size(); i++) {
+			const string& call = _calls[i];
+			Stage* stage = performCall(&seq, g, Group::home, call);
+			if (stage == null) {
+				printf(" *** '%s' does not work from home\n", call.c_str());
+				result = false;
+				continue;
+			}
+			const vector<Group*>& groups = stage->groups();
+			int stale = 0;
+			for (int j = 0; j < groups.size(); j++)
+				if (!groups[j]->hashesCurrent())
+					stale++;
+			if (stale) {
+				printf(" *** '%s': %d of %d groups carried stale hashes\n", call.c_str(), stale, groups.size());
+				result = false;
+			}
+			delete stage;
+		}
+		if (!result)
+			return false;
+		return runAnyContent();
+	}
+
+	vector<string>	_calls;
+	Grammar*		_localGrammar;
+};
+/*
+ *	BreathingObject
+ *
+ *	Performs each of a ';' separated list of calls from home and from the final
+ *	position of each of those calls, twice: once with the grammar's breathing
+ *	solutions left in place and once with them cleared before every call.  The
+ *	two passes must breathe every call to the same final position.
+ */
+class BreathingObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new BreathingObject();
+	}
+
+private:
+	BreathingObject() {
+		_localGrammar = null;
+	}
+
+	~BreathingObject() {
+		delete _localGrammar;
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		script::Atom* a = get("calls");
+		string calls = a ? a->toString() : "heads pass thru;heads star thru;heads square thru 4;circle left 1/4;heads lead right;heads face right";
+		for (int start = 0; start < calls.size();) {
+			int end = calls.find(';', start);
+			if (end == string::npos)
+				end = calls.size();
+			_calls.push_back(calls.substr(start, end - start).trim());
+			start = end + 1;
+		}
+		return true;
+	}
+
+	virtual bool run() {
+		GrammarObject* go;
+		Grammar* g;
+		if (containedBy(&go))
+			g = go->grammar();
+		else {
+			g = new Grammar();
+			_localGrammar = g;
+			if (!g->read(global::dataFolder + "/dance/calls.cdf")) {
+				printf("Could not load default definitions\n");
+				return false;
+			}
+		}
+		g->compileStateMachines();
+		Sequence seq(null);
+		vector<Stage*> setups;
+		vector<const Group*> starts;
+		starts.push_back(Group::home);
+		for (int i = 0; i < _calls.size(); i++) {
+			Stage* stage = performCall(&seq, g, Group::home, _calls[i]);
+			if (stage) {
+				setups.push_back(stage);
+				starts.push_back(stage->final());
+			}
+		}
+		vector<Stage*> warm;
+		vector<Stage*> cold;
+		for (int pass = 0; pass < 2; pass++) {
+			for (int i = 0; i < starts.size(); i++)
+				for (int j = 0; j < _calls.size(); j++) {
+					if (pass == 1)
+						g->breathingSolutions()->clear();
+					Stage* stage = performCall(&seq, g, starts[i], _calls[j]);
+					if (pass == 0)
+						warm.push_back(stage);
+					else
+						cold.push_back(stage);
+				}
+		}
+		bool result = true;
+		for (int i = 0; i < warm.size(); i++) {
+			const string& call = _calls[i % _calls.size()];
+			int start = i / _calls.size();
+			if (warm[i] == null && cold[i] == null)
+				continue;
+			if (warm[i] == null || cold[i] == null) {
+				printf(" *** '%s' from start %d worked only %s\n", call.c_str(), start, warm[i] ? "with remembered solutions" : "with the solutions cleared");
+				result = false;
+			} else if (!warm[i]->final()->equals(cold[i]->final())) {
+				printf(" *** '%s' from start %d breathes differently with the solutions cleared\n", call.c_str(), start);
+				result = false;
+			}
+		}
+		setups.deleteAll();
+		warm.deleteAll();
+		cold.deleteAll();
+		if (!result)
+			return false;
+		return runAnyContent();
+	}
+
+	vector<string>	_calls;
+	Grammar*		_localGrammar;
+};
+
+/*
+ *	CollisionsObject
+ *
+ *	From the eight chain thru formation that heads square thru 4 leaves, performs a
+ *	pass thru, which must not be reported as a collision, and a call defined here to
+ *	walk the facing dancers nose to nose, which must be.
+ */
+class CollisionsObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new CollisionsObject();
+	}
+
+private:
+	CollisionsObject() {
+		_localGrammar = null;
+	}
+
+	~CollisionsObject() {
+		delete _localGrammar;
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		return true;
+	}
+
+	virtual bool run() {
+		GrammarObject* go;
+		Grammar* g;
+		if (containedBy(&go))
+			g = go->grammar();
+		else {
+			g = new Grammar();
+			_localGrammar = g;
+			if (!g->read(global::dataFolder + "/dance/calls.cdf")) {
+				printf("Could not load default definitions\n");
+				return false;
+			}
+		}
+		Definition* bump = new Definition(g);
+		bump->setLevel("Basic");
+		bump->setProduction(bump->addProduction(), "meet nose to nose");
+		bump->addPattern("facing");
+		bump->action("$forward(1/2)");
+		g->addDefinition(bump);
+		bump->verify(g);
+		g->touch();
+		g->compileStateMachines();
+
+		bool result = true;
+		Sequence seq(null);
+		Stage* setup = performCall(&seq, g, Group::home, "heads square thru 4");
+		if (setup == null) {
+			printf(" *** 'heads square thru 4' does not work from home\n");
+			result = false;
+		} else {
+			if (collides(&seq, g, setup->final(), "pass thru", &result)) {
+				printf(" *** pass thru was reported as a collision\n");
+				result = false;
+			}
+			if (!collides(&seq, g, setup->final(), "meet nose to nose", &result)) {
+				printf(" *** walking nose to nose was not reported as a collision\n");
+				result = false;
+			}
+			delete setup;
+		}
+		g->removeDefinition(bump);
+		delete bump;
+		g->touch();
+		g->compileStateMachines();
+		if (!result)
+			return false;
+		return runAnyContent();
+	}
+	/*
+	 *	collides
+	 *
+	 *	Performs the call and reports whether checking its collisions warned of one.
+	 *	Clears *result if the call can't be performed or was already warned about.
+	 */
+	bool collides(Sequence* seq, const Grammar* g, const Group* start, const string& call, bool* result) {
+		Stage* stage = performCall(seq, g, start, call);
+		if (stage == null) {
+			printf(" *** '%s' does not work\n", call.c_str());
+			*result = false;
+			return false;
+		}
+		if (stage->cause()) {
+			printf(" *** '%s' has a warning before collisions are checked: %s\n", call.c_str(), stage->cause()->text().c_str());
+			*result = false;
+			delete stage;
+			return false;
+		}
+		stage->collectMotions();
+		stage->checkCollisions();
+		bool collided = stage->cause() != null;
+		delete stage;
+		return collided;
+	}
+
+	Grammar*		_localGrammar;
+};
+
+/*
+ *	JournalObject
+ *
+ *	Saves a dance to the named file, then changes one sequence and adds another and
+ *	saves only those changes, to the journal.  Reading the dance back must go through
+ *	the index, leaving the unchanged sequences unread, replay the journal, and give
+ *	every sequence its calls, notes, comment and status as they were.  So must reading
+ *	it again after compacting the journal into the file.  The files are removed
+ *	afterward.
+ */
+class JournalObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new JournalObject();
+	}
+
+private:
+	JournalObject() {
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		script::Atom* a = get("filename");
+		if (a == null) {
+			printf("No filename\n");
+			return false;
+		}
+		_path = fileSystem::pathRelativeTo(a->toString(), parser->filename());
+		a = get("sequences");
+		_sequences = a ? a->toString().toInt() : 40;
+		if (_sequences < 2) {
+			printf("Need at least two sequences\n");
+			return false;
+		}
+		return true;
+	}
+
+	virtual bool run() {
+		vector<string> expected;
+		Dance original("journal", _path);
+		for (int i = 0; i < _sequences; i++) {
+			Sequence* s = original.newSequence();
+			s->created = 1000000 + i;
+			s->status = SequenceStatus(i % (SEQ_READY + 1));
+			s->comment.printf("sequence %d", i);
+			s->append("heads square thru 4");
+			s->appendNotes("");
+			s->append("swing thru");
+			s->appendNotes(string("note ") + i);
+			s->append("allemande left");
+			s->appendNotes("");
+		}
+		bool result = original.save();
+		if (!result)
+			printf(" *** Could not save %s\n", _path.c_str());
+
+		Sequence* changed = original.sequences()[1];
+		changed->setCall(1, "boys run");
+		changed->status = SEQ_UNCHECKED;
+		original.touch(changed);
+		Sequence* added = original.newSequence();
+		added->created = 2000000;
+		added->comment = "added";
+		added->append("circle left");
+		added->appendNotes("all the way");
+		original.touch(added);
+		if (result && !original.saveChanges()) {
+			printf(" *** Could not save the changes to %s\n", _path.c_str());
+			result = false;
+		}
+		if (result && !fileSystem::exists(_path + ".journal")) {
+			printf(" *** The changes were not written to the journal\n");
+			result = false;
+		}
+		for (int i = 0; i < original.sequences().size(); i++)
+			expected.push_back(snapshot(original.sequences()[i]));
+
+		if (result)
+			result = compare(expected, true);
+		if (result) {
+			Dance journaled("journal", _path);
+			if (!journaled.read() || !journaled.compact()) {
+				printf(" *** Could not compact %s\n", _path.c_str());
+				result = false;
+			}
+		}
+		if (result)
+			result = compare(expected, false);
+		remove(_path.c_str());
+		remove((_path + ".index").c_str());
+		remove((_path + ".journal").c_str());
+		remove((_path + ".stages").c_str());
+		if (!result)
+			return false;
+		return runAnyContent();
+	}
+	/*
+	 *	compare
+	 *
+	 *	Reads the dance and compares its sequences with the expected snapshots.
+	 *	Sequence 0 was never changed, so it must still be unread if the dance came
+	 *	through the index.
+	 */
+	bool compare(const vector<string>& expected, bool journaled) {
+		const char* how = journaled ? "with the journal" : "after compacting";
+		Dance dance("journal", _path);
+		if (!dance.read()) {
+			printf(" *** Could not read %s %s\n", _path.c_str(), how);
+			return false;
+		}
+		const vector<Sequence*>& sequences = dance.sequences();
+		if (sequences.size() != expected.size()) {
+			printf(" *** Read %d sequences %s, expected %d\n", sequences.size(), how, expected.size());
+			return false;
+		}
+		bool result = true;
+		if (sequences[0]->loaded()) {
+			printf(" *** The dance was not read through its index %s\n", how);
+			result = false;
+		}
+		for (int i = 0; i < sequences.size(); i++) {
+			string s = snapshot(sequences[i]);
+			if (s != expected[i]) {
+				printf(" *** Sequence %d %s:\n%s\n    expected:\n%s\n", i, how, s.c_str(), expected[i].c_str());
+				result = false;
+			}
+		}
+		return result;
+	}
+
+	static string snapshot(const Sequence* s) {
+		string text;
+
+		text.printf("    created %d status %d comment '%s'\n", int(s->created), int(s->status), s->comment.c_str());
+		for (int i = 0; i < s->text().size(); i++)
+			text.printf("    %s # %s\n", s->text()[i].c_str(), i < s->notes().size() ? s->notes()[i].c_str() : "");
+		return text;
+	}
+
+	string	_path;
+	int		_sequences;
 };
 
+static Stage* performCall(Sequence* seq, const Grammar* g, const Group* dancers, const string& call) {
+	Context context(seq, g);
+	Stage* stage = new Stage(seq, dancers, g->termPool());
+	context.startStage(stage);
+	const Anything* c = g->parse(null, call, false, null, &context, null);
+	if (c == null) {
+		context.endStage();
+		delete stage;
+		return null;
+	}
+	stage->setCall(c);
+	stage->perform(null, &context, TILE_ALL);
+	stage->breathe(&context);
+	context.endStage();
+	if (stage->failed() || stage->final() == null) {
+		delete stage;
+		return null;
+	}
+	return stage;
+}
 
 void initTestObjects() {
 	script::objectFactory("d_grammar", GrammarObject::factory);
 	script::objectFactory("d_dance", DanceObject::factory);
+	script::objectFactory("d_sd_read", SdReadObject::factory);
+	script::objectFactory("d_outcomes", OutcomesObject::factory);
+	script::objectFactory("d_canonical", CanonicalObject::factory);
+	script::objectFactory("d_hashes", HashesObject::factory);
+	script::objectFactory("d_breathing", BreathingObject::factory);
+	script::objectFactory("d_collisions", CollisionsObject::factory);
+	script::objectFactory("d_journal", JournalObject::factory);
 	script::objectFactory("d_transform", TransformObject::factory);
 	script::objectFactory("d_parse", ParseObject::factory);
 	script::objectFactory("d_expect", ExpectObject::factory);
@@ -19,10 +19,16 @@
 #include "../display/tabbed_group.h"
 #include "../display/window.h"
 #include "../engine/global.h"
-#include "../sd/sd.h"
 #include "call.h"
 #include "dance.h"
+#include "benchmark.h"
+#include "coverage.h"
+#include "flow.h"
+#include "generator.h"
 #include "motion.h"
+#include "render.h"
+#include "resolve.h"
+#include "sd_stream.h"
 
 namespace dance {
 
@@ -42,12 +48,14 @@ bool loadState = true;
 
 static string findUserFolder();
 static void loadStateFile();
+static int parseOptions(int argc, char** argv);
 
 script::Atom* preferences;
 display::Window* danceWindow;
 DanceFrame* danceFrame;
 
 void launch(int argc, char** argv) {
+	int files = parseOptions(argc, argv);
 	if (loadState)
 		loadStateFile();
 	initializePrecedences();
@@ -62,20 +70,206 @@ void launch(int argc, char** argv) {
 	if (!loadLibrary())
 		warningMessage("Couldn't load my sequence library");
 	if (showUI) {
+		leanStages = true;
 		danceWindow = new display::Window();
 		danceFrame = new DanceFrame();
 		danceFrame->bind(danceWindow);
 		danceWindow->show();
 	}
-	for (int i = 0; i < argc; i++) {
+	FlowReport flowReport;
+	VariantCoverage coverage;
+	Benchmark* benchmark = null;
+	if (!showUI && benchmarkFile.size()) {
+		string defsFile = getPreference("definitions");
+		if (defsFile.size() == 0)
+			defsFile = global::dataFolder + "/dance/calls.cdf";
+		benchmark = new Benchmark(defsFile, benchmarkRuns, benchmarkScale);
+	}
+	bool regressed = false;				// a benchmark regression, reported in the exit status
+	FILE* sdCheckOut = null;
+	if (!showUI && sdCheckFile.size()) {
+		sdCheckOut = fileSystem::createTextFile(sdCheckFile);
+		if (sdCheckOut == null)
+			printf("Could not write %s\n", sdCheckFile.c_str());
+	}
+	for (int i = files; i < argc; i++) {
 		if (showUI) {
 			string filename = fileSystem::absolutePath(argv[i]);
 			danceFrame->openFile(filename);
+		} else if (renderFolder.size()) {
+			string filename = fileSystem::absolutePath(argv[i]);
+			if (!renderDanceFile(filename, myDefinitions, renderFolder))
+				printf("Could not render %s\n", filename.c_str());
+		}
+		if (!showUI && flowReportFile.size()) {
+			string filename = fileSystem::absolutePath(argv[i]);
+			if (!flowReport.analyze(filename, myDefinitions))
+				printf("Could not read %s\n", filename.c_str());
+		}
+		if (sdCheckOut) {
+			string filename = fileSystem::absolutePath(argv[i]);
+			SdCheck check(myDefinitions, false);
+			if (!check.check(filename, sdCheckOut))
+				printf("Could not read %s\n", filename.c_str());
+			check.writeTotals(sdCheckOut, filename);
+		}
+		if (!showUI && coverageFile.size()) {
+			string filename = fileSystem::absolutePath(argv[i]);
+			VariantCoverage fileCoverage;
+			if (fileCoverage.cover(filename, myDefinitions))
+				coverage.merge(fileCoverage);
+			else
+				printf("Could not read %s\n", filename.c_str());
 		}
+		if (benchmark)
+			benchmark->addFile(fileSystem::absolutePath(argv[i]));
+	}
+	if (sdCheckOut)
+		fclose(sdCheckOut);
+	if (!showUI && generateFile.size()) {
+		if (!generateDanceFile(generateFile, myDefinitions, generateLevel, generateCount, generateSeed))
+			printf("Could not write %s\n", generateFile.c_str());
+	}
+	if (benchmark) {
+		if (benchmark->run()) {
+			if (benchmarkBaseline.size()) {
+				int regressions = benchmark->compare(benchmarkBaseline);
+				if (regressions < 0)
+					printf("Could not read %s\n", benchmarkBaseline.c_str());
+				for (int i = 0; i < regressions; i++)
+					printf("Regression in %s\n", benchmark->regressions()[i].c_str());
+				if (regressions > 0)
+					regressed = true;
+			}
+			FILE* out = fileSystem::createTextFile(benchmarkFile);
+			if (out) {
+				benchmark->write(out);
+				fclose(out);
+			} else
+				printf("Could not write %s\n", benchmarkFile.c_str());
+		}
+		delete benchmark;
+	}
+	if (!showUI && microBenchmarkFile.size()) {
+		// The other batch modes check the user's dance files against their own
+		// definitions.  The micro-benchmark only times the engine on generated
+		// inputs, so it uses the shipped definitions alone: then results from
+		// different machines, or before and after editing my definitions, compare.
+
+		MicroBenchmark micro(defaultDefinitions, benchmarkRuns);
+		micro.run();
+		if (microBenchmarkBaseline.size()) {
+			int regressions = micro.compare(microBenchmarkBaseline);
+			if (regressions < 0)
+				printf("Could not read %s\n", microBenchmarkBaseline.c_str());
+			for (int i = 0; i < regressions; i++)
+				printf("Regression in %s\n", micro.regressions()[i].c_str());
+			if (regressions > 0)
+				regressed = true;
+		}
+		FILE* out = fileSystem::createTextFile(microBenchmarkFile);
+		if (out) {
+			micro.write(out);
+			fclose(out);
+		} else
+			printf("Could not write %s\n", microBenchmarkFile.c_str());
+	}
+	if (!showUI && coverageFile.size()) {
+		FILE* out = fileSystem::createTextFile(coverageFile);
+		if (out) {
+			coverage.write(out, myDefinitions, NO_LEVEL);
+			fclose(out);
+		} else
+			printf("Could not write %s\n", coverageFile.c_str());
+	}
+	if (!showUI && flowReportFile.size()) {
+		FILE* out = fileSystem::createTextFile(flowReportFile);
+		if (out) {
+			flowReport.write(out);
+			fclose(out);
+		} else
+			printf("Could not write %s\n", flowReportFile.c_str());
 	}
 	atexit(clearMemory);
 	if (!showUI)
-		exit(0);
+		exit(regressed ? 1 : 0);
+}
+
+struct StringOption {
+	const char*	name;
+	string*		value;
+	bool		batch;				// the option runs without a UI
+};
+
+static StringOption stringOptions[] = {
+	{ "-render",					&renderFolder,				true },
+	{ "-flowReport",				&flowReportFile,			true },
+	{ "-sdCheck",					&sdCheckFile,				true },
+	{ "-coverage",					&coverageFile,				true },
+	{ "-benchmark",					&benchmarkFile,				true },
+	{ "-benchmarkBaseline",			&benchmarkBaseline,			false },
+	{ "-microBenchmark",			&microBenchmarkFile,		true },
+	{ "-microBenchmarkBaseline",	&microBenchmarkBaseline,	false },
+	{ "-generate",					&generateFile,				true },
+	{ "-generateLevel",				&generateLevel,				false },
+};
+
+struct IntOption {
+	const char*	name;
+	int*		value;
+};
+
+static IntOption intOptions[] = {
+	{ "-benchmarkRuns",				&benchmarkRuns },
+	{ "-benchmarkScale",			&benchmarkScale },
+	{ "-generateCount",				&generateCount },
+};
+/*
+ *	parseOptions
+ *
+ *	Sets the batch mode globals from the leading arguments, each an option name
+ *	followed by its value, as in '-benchmark results.json'.  The options end at the
+ *	first argument that does not start with '-', or after '--'.  Any option that
+ *	writes a batch result turns the UI off.  Returns the index of the first file
+ *	argument.
+ */
+static int parseOptions(int argc, char** argv) {
+	int i = 0;
+	while (i < argc && argv[i][0] == '-') {
+		string name(argv[i]);
+		i++;
+		if (name == "--")
+			break;
+		if (i >= argc) {
+			printf("Option %s needs a value\n", name.c_str());
+			break;
+		}
+		const char* value = argv[i];
+		bool found = false;
+		for (int j = 0; j < dimOf(stringOptions); j++) {
+			if (name == stringOptions[j].name) {
+				*stringOptions[j].value = value;
+				if (stringOptions[j].batch)
+					showUI = false;
+				found = true;
+			}
+		}
+		for (int j = 0; j < dimOf(intOptions); j++) {
+			if (name == intOptions[j].name) {
+				*intOptions[j].value = atoi(value);
+				found = true;
+			}
+		}
+		if (name == "-generateSeed") {
+			generateSeed = strtoul(value, null, 10);
+			found = true;
+		}
+		if (found)
+			i++;
+		else
+			printf("Unknown option %s\n", name.c_str());
+	}
+	return i;
 }
 
 DanceFrame::DanceFrame() {
@@ -108,12 +302,30 @@ DanceFrame::~DanceFrame() {
 	delete _animator;
 	_sequenceEditors.deleteAll();
 	_danceEditors.deleteAll();
+	_candidateCalls.deleteAll();
 }
 
 void DanceFrame::shutdown() {
 	_shuttingDown = true;
 }
 
+const CandidateCalls* DanceFrame::candidateCalls(const Grammar* grammar, Level level) {
+	for (int i = 0; i < _candidateCalls.size(); i++) {
+		CandidateCalls* c = _candidateCalls[i];
+		if (c->level() != level)
+			continue;
+		if (!c->matches(grammar, level)) {
+			delete c;
+			c = new CandidateCalls(grammar, level);
+			_candidateCalls[i] = c;
+		}
+		return c;
+	}
+	CandidateCalls* c = new CandidateCalls(grammar, level);
+	_candidateCalls.push_back(c);
+	return c;
+}
+
 void DanceFrame::bind(display::RootCanvas* c) {
 	c->onFunctionKey(display::FK_F1, 0, &_helpFunction); 
 	_helpFunction.addHandler(this, &DanceFrame::onHelp);
@@ -268,7 +480,7 @@ bool DanceFrame::openFile(const string &filename) {
 				return true;
 			}
 		}
-		Dance* d = parseSdFile(filename);
+		Dance* d = readSdDance(filename);
 		if (d == null) {
 			warningMessage("Could not load " + filename);
 			return false;
@@ -474,7 +686,9 @@ void DanceFrame::drillDown(int index, Sequence* sequence) {
 		_drillDown->owner()->select(_drillDown);
 	else
 		selectStartup(_drillDown, _drillDownStart / 10);
-	const Stage* s = sequence->stages()[index];
+	const Stage* s = sequence->expandStage(index, myDefinitions);
+	if (s == null || s->stepCount() == 0)
+		return;
 	if (s->stepCount() > 1 || s->step(0)->tiles().size() == 1)
 		_drillDown->show(new PlanSeed(_drillDown, s));
 	else
@@ -603,6 +817,18 @@ void DanceFrame::exitIfClean() {
 		} else if (a == IDCANCEL)
 			return;
 	}
+	// Fold the journals of saved dances back into their files, leaving alone any
+	// dance whose changes were just declined.  Stage results are keyed by the text
+	// of each sequence, so they are worth keeping either way.
+
+	for (int i = 0; i < _danceEditors.size(); i++) {
+		if (!_danceEditors[i]->needsSave())
+			_danceEditors[i]->dance()->compact();
+		_danceEditors[i]->dance()->saveStageCache();
+	}
+	if (!_libraryEditor->needsSave())
+		_libraryEditor->dance()->compact();
+	_libraryEditor->dance()->saveStageCache();
 	exit(0);
 }
 
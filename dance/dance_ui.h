@@ -33,6 +33,7 @@ namespace dance {
 class ActionEditor;
 class Animator;
 class Browser;
+class CandidateCalls;
 class Dance;
 class DanceEditor;
 class DanceFileEditor;
@@ -156,6 +157,13 @@ public:
 	GrammarEditor* defaultEditor() const { return _defaultEditor; }
 
 	GrammarEditor* myDefinitionsEditor() const { return _myDefinitionsEditor; }
+	/*
+	 *	candidateCalls
+	 *
+	 *	The calls the sequence editors' searches try, kept from one search to the next
+	 *	and parsed again only when the grammar changes.  One list is kept per level.
+	 */
+	const CandidateCalls* candidateCalls(const Grammar* grammar, Level level);
 
 private:
 	void onIdle();
@@ -200,6 +208,7 @@ private:
 	display::VerticalSliderHandler*						_sliderHandler;
 	bool												_shuttingDown;
 	void*												_idleHandler;
+	vector<CandidateCalls*>								_candidateCalls;
 };
 
 class PreferencesEditor : public display::TabManager {
@@ -988,6 +997,12 @@ private:
 
 	void deleteCall(display::point p, display::Canvas* target, int i);
 
+	void findResolve(display::point p, display::Canvas* target, int i);
+
+	void findZeros(display::point p, display::Canvas* target, int i);
+
+	void findEquivalents(display::point p, display::Canvas* target, int i);
+
 	void onCommentChanged();
 
 	void onLevelChanged();
@@ -1264,6 +1279,7 @@ public:
 		_picture = picture;
 		_timeIndex = 0;
 		_ticksPerBeat = 0;
+		_stageStarts.push_back(0);
 		setSpeed(3);
 	}
 
@@ -1292,11 +1308,20 @@ public:
 	int timeIndex() const { return _timeIndex; }
 
 private:
+	/*
+	 *	stageAt
+	 *
+	 *	Returns the index of the stage playing at the given tick, and the tick
+	 *	at which that stage starts.
+	 */
+	int stageAt(int timeIndex, int* stageStart) const;
+
 	SequenceEditor* _editor;
 	Picture* _picture;
 	int _timeIndex;
 	int _ticksPerBeat;
 	vector<beats> _stageDurations;
+	vector<beats> _stageStarts;			// beat at which each stage starts, plus the total duration
 	beats _duration;
 };
 
@@ -1360,8 +1385,6 @@ public:
 
 	bool paintMotion(display::Device* device, int dancerIndex, const Motion* motion, double partial);
 
-	const Motion* combineMotion(const Motion* motion, double partial, double* x, double* y, double* noseAngle);
-
 	void paintFinishedMotion(display::Device* device, int dancerIndex, const Motion* m);
 
 	virtual bool bufferedDisplay(display::Device* device);
@@ -1384,8 +1407,6 @@ private:
 
 	double getBaseAngle() const;
 
-	void facingToAngles(Facing facing, double* noseAngle, double* secondNoseAngle);
-
 	void drawDancer(display::Device* device, double baseAngle, const Dancer* dancer);
 
 	void drawDancer(display::Device* device, Gender gender, int couple, double x, double y, double noseAngle, double secondNoseAngle);
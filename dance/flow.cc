@@ -0,0 +1,206 @@
+#include "../common/platform.h"
+#include "flow.h"
+
+#include <math.h>
+#include "../common/file_system.h"
+#include "../common/timing.h"
+#include "call.h"
+#include "motion.h"
+
+namespace dance {
+
+static double normalDelta(double angle);
+
+FlowMetrics::FlowMetrics() {
+	clear();
+}
+
+void FlowMetrics::clear() {
+	dancerCount = 0;
+	duration = 0;
+	for (int i = 0; i < MAX_DANCERS; i++) {
+		turning[i] = 0;
+		reversals[i] = 0;
+		idleSamples[i] = 0;
+		distance[i] = 0;
+	}
+}
+
+void FlowMetrics::add(const FlowMetrics& other) {
+	if (other.dancerCount > dancerCount)
+		dancerCount = other.dancerCount;
+	duration += other.duration;
+	for (int i = 0; i < MAX_DANCERS; i++) {
+		turning[i] += other.turning[i];
+		reversals[i] += other.reversals[i];
+		idleSamples[i] += other.idleSamples[i];
+		distance[i] += other.distance[i];
+	}
+}
+
+void FlowMetrics::measure(const Stage* stage) {
+	timing::Timer t("FlowMetrics::measure");
+	int lanes = stage->dancerCount();
+	if (lanes > MAX_DANCERS)
+		lanes = MAX_DANCERS;
+	if (lanes > dancerCount)
+		dancerCount = lanes;
+	int samples = stage->duration() * FLOW_SAMPLES_PER_BEAT;
+	duration += stage->duration();
+
+	double x[MAX_DANCERS], y[MAX_DANCERS], nose[MAX_DANCERS];
+	double lastX[MAX_DANCERS], lastY[MAX_DANCERS], lastNose[MAX_DANCERS];
+	double heading[MAX_DANCERS];
+	bool located[MAX_DANCERS], lastLocated[MAX_DANCERS];
+
+	for (int i = 0; i < MAX_DANCERS; i++) {
+		lastLocated[i] = false;
+		heading[i] = NOT_AN_ANGLE;
+	}
+	for (int k = 0; k <= samples; k++) {
+		double partial = k ? double(k) / FLOW_SAMPLES_PER_BEAT : EPSILON;
+
+		// Motion lookup is per dancer, everything after it runs lane by lane.
+
+		for (int i = 0; i < lanes; i++)
+			located[i] = locateMotion(stage->activeMotion(i, partial), partial, &x[i], &y[i], &nose[i]);
+		for (int i = 0; i < lanes; i++) {
+			if (located[i] && lastLocated[i]) {
+				double dx = x[i] - lastX[i];
+				double dy = y[i] - lastY[i];
+				double step = sqrt(dx * dx + dy * dy);
+				double turn = fabs(normalDelta(nose[i] - lastNose[i]));
+				distance[i] += step;
+				turning[i] += turn;
+				if (step < EPSILON / 8) {
+					if (turn < EPSILON / 8)
+						idleSamples[i]++;
+				} else {
+					double angle = atan2(dy, dx);
+					if (heading[i] != NOT_AN_ANGLE && fabs(normalDelta(angle - heading[i])) > 13 * PI / 16)
+						reversals[i]++;
+					heading[i] = angle;
+				}
+			}
+			lastLocated[i] = located[i];
+			lastX[i] = x[i];
+			lastY[i] = y[i];
+			lastNose[i] = nose[i];
+		}
+	}
+}
+
+double FlowMetrics::roughness() const {
+	if (duration == 0)
+		return 0;
+	double worst = 0;
+	for (int i = 0; i < dancerCount; i++) {
+		double r = (turning[i] / (PI / 2) + 4 * reversals[i]) / duration;
+		if (r > worst)
+			worst = r;
+	}
+	return worst;
+}
+
+double FlowMetrics::totalTurning() const {
+	double sum = 0;
+	for (int i = 0; i < dancerCount; i++)
+		sum += turning[i];
+	return sum;
+}
+
+int FlowMetrics::totalReversals() const {
+	int sum = 0;
+	for (int i = 0; i < dancerCount; i++)
+		sum += reversals[i];
+	return sum;
+}
+
+double FlowMetrics::totalIdleBeats() const {
+	int sum = 0;
+	for (int i = 0; i < dancerCount; i++)
+		sum += idleSamples[i];
+	return double(sum) / FLOW_SAMPLES_PER_BEAT;
+}
+
+double FlowMetrics::totalDistance() const {
+	double sum = 0;
+	for (int i = 0; i < dancerCount; i++)
+		sum += distance[i];
+	return sum;
+}
+
+int FlowEntry::compare(const FlowEntry* other) const {
+	if (failed != other->failed)
+		return failed ? 1 : -1;
+	double r1 = metrics.roughness();
+	double r2 = other->metrics.roughness();
+	if (r1 < r2)
+		return -1;
+	else if (r1 > r2)
+		return 1;
+	int c = label.compare(&other->label);
+	if (c)
+		return c;
+	return index - other->index;
+}
+
+FlowReport::~FlowReport() {
+	_entries.deleteAll();
+}
+
+void FlowReport::analyze(Dance* dance, const Grammar* grammar) {
+	const vector<Sequence*>& sequences = dance->sequences();
+	for (int i = 0; i < sequences.size(); i++) {
+		Sequence* s = sequences[i];
+		s->updateStages(grammar);
+		const vector<const Stage*>& stages = s->stages();
+		bool failed = false;
+		FlowEntry* entry = new FlowEntry(dance->label(), i + 1, false);
+		for (int j = 0; j < stages.size(); j++) {
+			if (stages[j] == null || stages[j]->failed()) {
+				failed = true;
+				break;
+			}
+			FlowMetrics stageMetrics;
+			stageMetrics.measure(stages[j]);
+			entry->metrics.add(stageMetrics);
+		}
+		entry->failed = failed;
+		_entries.push_back(entry);
+		s->clearStages();
+	}
+}
+
+bool FlowReport::analyze(const string& filename, const Grammar* grammar) {
+	Dance d(fileSystem::basename(filename), filename);
+	if (!d.read())
+		return false;
+	analyze(&d, grammar);
+	return true;
+}
+
+void FlowReport::write(FILE* out) {
+	_entries.sort();
+	fprintf(out, "roughness  beats  turns  reversals  idle  distance  sequence\n");
+	for (int i = 0; i < _entries.size(); i++) {
+		const FlowEntry* e = _entries[i];
+		const FlowMetrics& m = e->metrics;
+		if (e->failed)
+			fprintf(out, "   failed                                           %s #%d\n", e->label.c_str(), e->index);
+		else
+			fprintf(out, "%9.2f  %5d  %5.1f  %9d  %4.1f  %8.1f  %s #%d\n", m.roughness(), m.duration, 
+					m.totalTurning() / (PI / 2), m.totalReversals(), m.totalIdleBeats(), m.totalDistance(), 
+					e->label.c_str(), e->index);
+	}
+}
+
+static double normalDelta(double angle) {
+	while (angle > PI)
+		angle -= 2 * PI;
+	while (angle <= -PI)
+		angle += 2 * PI;
+	return angle;
+}
+
+}  // namespace dance
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdio.h>
+#include "dance.h"
+
+namespace dance {
+
+class Dance;
+class Grammar;
+class Stage;
+
+const int FLOW_SAMPLES_PER_BEAT = 8;
+/*
+ *	FlowMetrics
+ *
+ *	Body-flow measurements for one stage, or the sum over a sequence.  Each array
+ *	holds one lane per dancer, and measure updates all the lanes together one sample
+ *	at a time.
+ */
+class FlowMetrics {
+public:
+	FlowMetrics();
+
+	void clear();
+
+	void add(const FlowMetrics& other);
+	/*
+	 *	measure
+	 *
+	 *	Adds the stage's motions to the metrics, sampled FLOW_SAMPLES_PER_BEAT times
+	 *	a beat.
+	 */
+	void measure(const Stage* stage);
+	/*
+	 *	roughness
+	 *
+	 *	A single number for ranking: per dancer, quarter turns plus four for each
+	 *	reversal of direction, per beat of dancing.  The worst dancer sets the value.
+	 */
+	double roughness() const;
+
+	double totalTurning() const;
+
+	int totalReversals() const;
+
+	double totalIdleBeats() const;
+
+	double totalDistance() const;
+
+	int		dancerCount;
+	beats	duration;
+	double	turning[MAX_DANCERS];		// radians of nose rotation, either direction
+	int		reversals[MAX_DANCERS];		// abrupt changes in the direction of travel
+	int		idleSamples[MAX_DANCERS];	// samples with no motion and no turning
+	double	distance[MAX_DANCERS];		// distance travelled, in the same units as dancer positions
+};
+
+class FlowEntry {
+public:
+	FlowEntry(const string& label, int index, bool failed) {
+		this->label = label;
+		this->index = index;
+		this->failed = failed;
+	}
+	/*
+	 *	compare
+	 *
+	 *	Orders the smoothest sequences first.  Failed sequences go last.
+	 */
+	int compare(const FlowEntry* other) const;
+
+	string			label;
+	int				index;
+	bool			failed;
+	FlowMetrics		metrics;
+};
+/*
+ *	FlowReport
+ *
+ *	Collects the flow metrics of every sequence in one or more dances and writes
+ *	them out ranked by roughness, one line per sequence.
+ */
+class FlowReport {
+public:
+	~FlowReport();
+
+	void analyze(Dance* dance, const Grammar* grammar);
+
+	bool analyze(const string& filename, const Grammar* grammar);
+
+	void write(FILE* out);
+
+	int size() const { return _entries.size(); }
+
+private:
+	vector<FlowEntry*>	_entries;
+};
+
+}  // namespace dance
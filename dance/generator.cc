@@ -0,0 +1,225 @@
+#include "../common/platform.h"
+#include "generator.h"
+
+#include "../common/file_system.h"
+#include "../common/timing.h"
+#include "call.h"
+
+namespace dance {
+
+SequenceGenerator::SequenceGenerator(const Grammar* grammar, Level level, const GeneratorConstraints& constraints, unsigned seed) : CallSearch(grammar, level), _random(seed) {
+	_constraints.minCalls = constraints.minCalls;
+	_constraints.maxCalls = constraints.maxCalls;
+	_constraints.maxRepeats = constraints.maxRepeats;
+	_constraints.resolved = constraints.resolved;
+	for (int i = 0; i < constraints.required.size(); i++)
+		_constraints.required.push_back(constraints.required[i]);
+	_level = level;
+	_resolver = _constraints.resolved ? new Resolver(grammar, level) : null;
+	_cachedStages = 0;
+	_attempts = 0;
+	for (int i = 0; i < _constraints.required.size(); i++) {
+		int c;
+		for (c = 0; c < _candidates.size(); c++)
+			if (_candidates[c] == _constraints.required[i])
+				break;
+		if (c == _candidates.size()) {
+			printf("Required call '%s' is not a candidate at this level\n", _constraints.required[i].c_str());
+			c = -1;
+		}
+		_required.push_back(c);
+	}
+}
+
+SequenceGenerator::~SequenceGenerator() {
+	flush();
+	delete _resolver;
+}
+
+int SequenceGenerator::generate(Dance* dance, int count, int milliseconds) {
+	timing::Timer t("SequenceGenerator::generate");
+	for (int i = 0; i < _required.size(); i++)
+		if (_required[i] < 0)
+			return 0;
+	if (_candidates.size() == 0)
+		return 0;
+	startClock(milliseconds);
+	int added = 0;
+	vector<string> calls;
+	while (added < count && !expired()) {
+		if (_cachedStages >= GENERATOR_MAX_CACHED_STAGES)
+			flush();
+		if (!walk(&calls))
+			continue;
+		Sequence* s = dance->newSequence();
+		s->setLevel(_level);
+		s->comment = "Generated";
+		for (int i = 0; i < calls.size(); i++)
+			s->append(calls[i]);
+		added++;
+	}
+	return added;
+}
+
+bool SequenceGenerator::walk(vector<string>* calls) {
+	_attempts++;
+	calls->clear();
+	vector<int> used;
+	for (int i = 0; i < _candidates.size(); i++)
+		used.push_back(0);
+
+	// A sequence that must end resolved leaves room for the resolve.
+
+	int low = _constraints.minCalls;
+	int high = _constraints.maxCalls;
+	if (_constraints.resolved) {
+		low -= RESOLVE_MAX_CALLS;
+		high--;
+	}
+	if (low < 1)
+		low = 1;
+	if (high < low)
+		high = low;
+	int length = low + _random.next(high - low + 1);
+	const Group* dancers = Group::home;
+	for (int i = 0; i < length; i++) {
+		int c = pick(dancers, used, length - i);
+		if (c < 0)
+			return false;
+		used[c]++;
+		calls->push_back(_candidates[c]);
+		dancers = step(dancers, c)->final();
+	}
+	if (_constraints.resolved && !dancers->atHome()) {
+		int room = _constraints.maxCalls - calls->size();
+		if (room > RESOLVE_MAX_CALLS)
+			room = RESOLVE_MAX_CALLS;
+		if (room <= 0 || _resolver->search(dancers, room, GENERATOR_RESOLVE_MILLISECONDS) == 0)
+			return false;
+
+		// Take the first of the resolves found that keeps within the repeat limit.
+
+		const vector<CallList*>& resolves = _resolver->resolves();
+		int r;
+		for (r = 0; r < resolves.size(); r++) {
+			const vector<string>& resolve = resolves[r]->calls;
+			int j;
+			for (j = 0; j < resolve.size(); j++) {
+				int repeats = 0;
+				for (int k = 0; k < calls->size(); k++)
+					if ((*calls)[k] == resolve[j])
+						repeats++;
+				for (int k = 0; k < resolve.size(); k++)
+					if (resolve[k] == resolve[j])
+						repeats++;
+				if (repeats > _constraints.maxRepeats)
+					break;
+			}
+			if (j == resolve.size())
+				break;
+		}
+		if (r == resolves.size())
+			return false;
+		for (int j = 0; j < resolves[r]->calls.size(); j++)
+			calls->push_back(resolves[r]->calls[j]);
+	}
+	if (calls->size() < _constraints.minCalls)
+		return false;
+	return required(*calls) == 0;
+}
+/*
+ *	pick
+ *
+ *	Chooses the next call from the dancers' position.  A required call not used yet is
+ *	tried first, with a chance that rises as the slots left run out.  Otherwise random
+ *	candidates are tried, skipping any used up to the repeat limit and any that leave
+ *	the dancers as they were.  Returns -1 if none works.
+ */
+int SequenceGenerator::pick(const Group* dancers, vector<int>& used, int slotsLeft) {
+	int requiredLeft = 0;
+	int next = -1;
+	for (int i = 0; i < _required.size(); i++)
+		if (used[_required[i]] == 0) {
+			requiredLeft++;
+			if (next < 0)
+				next = _required[i];
+		}
+	if (next >= 0 && _random.next(slotsLeft) < requiredLeft && step(dancers, next) != null)
+		return next;
+	for (int i = 0; i < GENERATOR_TRIES; i++) {
+		int c = _random.next(_candidates.size());
+		if (used[c] >= _constraints.maxRepeats)
+			continue;
+		const Stage* stage = step(dancers, c);
+		if (stage == null || stage->final()->equals(dancers))
+			continue;
+		return c;
+	}
+	return -1;
+}
+
+int SequenceGenerator::required(const vector<string>& calls) const {
+	int missing = 0;
+	for (int i = 0; i < _constraints.required.size(); i++) {
+		int j;
+		for (j = 0; j < calls.size(); j++)
+			if (calls[j] == _constraints.required[i])
+				break;
+		if (j == calls.size())
+			missing++;
+	}
+	return missing;
+}
+
+const Stage* SequenceGenerator::step(const Group* dancers, int candidate) {
+	string key = positionKey(dancers) + ":" + string(candidate);
+	int* failed = _failures.get(key);
+	if (*failed)
+		return null;
+	Stage** cached = _steps.get(key);
+	if (*cached == null) {
+		*cached = perform(dancers, candidate);
+		if (*cached == null) {
+			*failed = 1;
+			return null;
+		}
+		_cachedStages++;
+	}
+	return *cached;
+}
+
+/*
+ *	flush
+ *
+ *	Empties the step cache between sequences.  The cached stages start from each
+ *	other's final groups, but a Stage does not delete its start group, so they can
+ *	be deleted in any order.
+ */
+void SequenceGenerator::flush() {
+	dictionary<Stage*>::iterator i = _steps.begin();
+	while (i.valid()) {
+		delete *i;
+		i.next();
+	}
+	_steps.clear();
+	_failures.clear();
+	_cachedStages = 0;
+}
+
+bool generateDanceFile(const string& filename, const Grammar* grammar, const string& levelName, int count, unsigned seed) {
+	Level level = *levelValues.get(levelName);
+	if (level == ERROR_LEVEL) {
+		printf("Unknown level: %s\n", levelName.c_str());
+		return false;
+	}
+	Dance dance(fileSystem::basename(filename), filename);
+	GeneratorConstraints constraints;
+	if (seed == 0)
+		seed = unsigned(time(null));
+	SequenceGenerator generator(grammar, level, constraints, seed);
+	int added = generator.generate(&dance, count, count * GENERATOR_MILLISECONDS_EACH);
+	printf("%s: %d sequences generated in %d attempts (seed %u)\n", filename.c_str(), added, generator.attempts(), seed);
+	return dance.save();
+}
+
+}  // namespace dance
@@ -0,0 +1,85 @@
+#pragma once
+#include "resolve.h"
+
+namespace dance {
+
+class Dance;
+
+const int GENERATOR_TRIES = 24;					// random calls tried at a position before giving up on it
+const int GENERATOR_RESOLVE_MILLISECONDS = 250;
+const int GENERATOR_MILLISECONDS_EACH = 1000;	// generateDanceFile's time budget, per sequence asked for
+const int GENERATOR_MAX_CACHED_STAGES = 4096;	// the step cache is flushed between sequences past this size
+
+class GeneratorConstraints {
+public:
+	GeneratorConstraints() {
+		minCalls = 6;
+		maxCalls = 12;
+		maxRepeats = 2;
+		resolved = true;
+	}
+
+	int				minCalls;
+	int				maxCalls;
+	int				maxRepeats;			// times any one call may appear in a sequence
+	bool			resolved;			// end at home
+	vector<string>	required;			// calls that must each appear
+};
+/*
+ *	SequenceGenerator
+ *
+ *	Writes random sequences at a level.  Each one is a random walk from home through
+ *	the candidate calls that work at each position, finished, if it must end resolved,
+ *	by the shortest resolve the Resolver finds in time.
+ *
+ *	The outcome of every call tried at a position is cached, keyed by the position and
+ *	the call, so the many walks that pass through the same positions (home above all)
+ *	perform each call there only once.
+ */
+class SequenceGenerator : public CallSearch {
+public:
+	SequenceGenerator(const Grammar* grammar, Level level, const GeneratorConstraints& constraints, unsigned seed);
+
+	~SequenceGenerator();
+	/*
+	 *	generate
+	 *
+	 *	Adds up to count new sequences to the dance, giving up after the given number
+	 *	of milliseconds.  Returns the number added.
+	 */
+	int generate(Dance* dance, int count, int milliseconds);
+
+	int attempts() const { return _attempts; }
+
+private:
+	bool walk(vector<string>* calls);
+
+	const Stage* step(const Group* dancers, int candidate);
+
+	int pick(const Group* dancers, vector<int>& used, int slotsLeft);
+
+	int required(const vector<string>& calls) const;
+
+	void flush();
+
+	GeneratorConstraints	_constraints;
+	Level					_level;
+	Resolver*				_resolver;
+	vector<int>				_required;			// candidate index of each required call
+	dictionary<Stage*>		_steps;				// position key:candidate -> stage
+	dictionary<int>			_failures;			// position key:candidate -> 1 if the call fails there
+	int						_cachedStages;
+	int						_attempts;
+	RandomNumbers			_random;
+};
+
+/*
+ *	generateDanceFile
+ *
+ *	Writes a new .dnc file of count random resolved sequences at the named level,
+ *	under the default constraints.  A seed of 0 is replaced by one taken from the
+ *	clock.  The seed used is printed, so a run can be repeated.
+ */
+bool generateDanceFile(const string& filename, const Grammar* grammar, const string& levelName, int count, unsigned seed);
+
+}  // namespace dance
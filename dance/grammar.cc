@@ -109,6 +109,8 @@ const char* dancerNames[] = {
 
 string Definition::_emptyLabel("<new>");
 
+static int grammarGeneration;			// the last version given to any grammar
+
 static bool validWordContent(char c, bool inDefinition);
 
 class DefinitionsContext {
@@ -773,12 +775,14 @@ private:
 
 Grammar::Grammar() {
 	_danceType = D_4COUPLE;
+	_version = ++grammarGeneration;
 	_error = false;
 	_backupGrammar = null;
 	_couple = null;
 	_changeHandler = null;
 
-	_termStorage = new Stage(null, null);
+	_termPool = new TermPool();
+	_termStorage = new Stage(null, null, _termPool);
 
 	_and = keyword("and");
 
@@ -921,6 +925,7 @@ Grammar::Grammar() {
 
 Grammar::~Grammar() {
 	delete _termStorage;
+	delete _termPool;
 	_words.deleteAll();
 	_synonyms.deleteAll();
 	_definitions.deleteAll();
@@ -973,9 +978,10 @@ void Grammar::setFilename(const string& filename) {
 
 void Grammar::touch() {
 	_lastChanged.touch();
+	_version = ++grammarGeneration;
 	_parseStates.clear();
 	delete _termStorage;
-	_termStorage = new Stage(null, null);
+	_termStorage = new Stage(null, null, _termPool);
 	changed.fire();
 }
 
@@ -1447,7 +1453,7 @@ bool Grammar::parsePartial(TokenType goalSymbol, const string& sentence, Level l
 		Sequence seq(null);
 		Context context(&seq, this);
 		seq.setLevel(level);
-		Stage tempStorage(&seq, null);
+		Stage tempStorage(&seq, null, _termPool);
 		context.startStage(&tempStorage);
 
 		vector<Token> tokens;
@@ -1495,6 +1501,25 @@ const Anything* Grammar::parse(const Group* dancers, const string& text, bool in
 		return null;
 }
 
+bool Grammar::tokenizeCall(const string& text, Context* context, vector<Token>* tokens) const {
+	return tokenize(null, text, false, null, context, null, *tokens, null);
+}
+
+const Anything* Grammar::compileAction(const string& text) const {
+	timing::Timer t("Grammar::compileAction");
+	Context context(null, this);
+	context.startStage(_termStorage);
+	vector<Token> tokens;
+	if (!tokenize(null, text, true, null, &context, null, tokens, null))
+		return null;
+	int matched;
+	const Anything* result = matchAnycall(true, tokens, 0, true, &matched, null, &context);
+	if (tokens.size() == matched)
+		return result;
+	else
+		return null;
+}
+
 const Anyone* Grammar::parseAnyone(const Group* dancers, const string& text, const Anything* call, Context* context, const Plan* variantPlan, const Term** local) const {
 	timing::Timer t("Grammar::parseAnyone");
 	vector<Token> tokens;
@@ -2034,6 +2059,7 @@ void Grammar::setBackupGrammar(Grammar* g) {
 		_changeHandler = null;
 	}
 	_backupGrammar = g; 
+	_version = ++grammarGeneration;
 	if (g)
 		_changeHandler = g->changed.addHandler(this, &Grammar::touch);
 }
@@ -2750,10 +2776,14 @@ void Part::write(FILE* fp) {
 }
 
 Step* SimpleAction::construct(PartStep* step, Context* context, TileAction tileAction) const {
-	const Anything* c = context->grammar()->parse(step->plan()->orientedStart(), 
-												  _action, 
-												  true, 
-												  step->plan()->call(), context, step->plan());
+	const Anything* c = null;
+	if (!step->plan()->hasLocals())
+		c = compiled(context->grammar());
+	if (c == null)
+		c = context->grammar()->parse(step->plan()->orientedStart(), 
+									  _action, 
+									  true, 
+									  step->plan()->call(), context, step->plan());
 	if (c)
 		return step->tiles()[0]->plan()->constructStep(c, context, tileAction);
 	else {
@@ -2766,6 +2796,14 @@ Step* SimpleAction::construct(PartStep* step, Context* context, TileAction tileA
 	}
 }
 
+const Anything* SimpleAction::compiled(const Grammar* grammar) const {
+	if (_compiledVersion != grammar->version()) {
+		_compiled = grammar->compileAction(_action);
+		_compiledVersion = grammar->version();
+	}
+	return _compiled;
+}
+
 bool SimpleAction::noop() const {
 	return _action.size() == 0;
 }
@@ -2779,6 +2817,10 @@ void SimpleAction::print(int indent) const {
 	printf("%*.*c'%s'\n", indent, indent, ' ', _action.c_str());
 }
 
+string SimpleAction::text() const {
+	return _action;
+}
+
 CompoundAction::~CompoundAction() {
 	_tracks.deleteAll();
 }
@@ -2867,6 +2909,18 @@ void CompoundAction::print(int indent) const {
 	}
 }
 
+string CompoundAction::text() const {
+	string s;
+
+	for (int i = 0; i < _tracks.size(); i++) {
+		Track* t = _tracks[i];
+		if (t->noop() && !t->anyWhoCan && !t->finishTogether)
+			continue;
+		s.printf("@%s %s\n#%s %s\n", t->finishTogether ? "T" : "F", t->who.c_str(), t->anyWhoCan ? "T" : "F", t->what.c_str());
+	}
+	return s;
+}
+
 bool Track::noop() const {
 	return who.size() == 0 && what.size() == 0;
 }
@@ -3416,9 +3470,7 @@ const Term* Fraction::negate(Context* context) const {
 	// 0 denominator means a 'magic' fraction that is not really numeric
 	if (_denominator == 0)
 		return null;
-	Fraction* f = context->stage()->newFraction(-_whole, -_numerator, _denominator);
-	f->normalize(context);
-	return f;
+	return context->stage()->newFraction(-_whole, -_numerator, _denominator)->normalize(context);
 }
 
 const Term* Fraction::not(Context* context) const {
@@ -3427,7 +3479,7 @@ const Term* Fraction::not(Context* context) const {
 		return null;
 	if (_numerator != 0)
 		return null;
-	return new Fraction(!_whole, 0, 1);
+	return context->stage()->newFraction(!_whole, 0, 1);
 }
 
 const Term* Fraction::positive(Context* context) const {
@@ -3444,11 +3496,10 @@ const Term* Fraction::add(const Term* operand, Context* context) const {
 	// 0 denominator means a 'magic' fraction that is not really numeric
 	if (_denominator == 0 || f->_denominator == 0)
 		return null;
-	Fraction* nf = new Fraction(_whole + f->_whole, 
-							   _numerator * f->_denominator + f->_numerator * _denominator, 
-							   _denominator * f->_denominator);
-	nf->normalize(context);
-	return nf;
+	Fraction nf(_whole + f->_whole, 
+				_numerator * f->_denominator + f->_numerator * _denominator, 
+				_denominator * f->_denominator);
+	return nf.normalize(context);
 }
 
 const Term* Fraction::subtract(const Term* operand, Context* context) const {
@@ -3458,11 +3509,10 @@ const Term* Fraction::subtract(const Term* operand, Context* context) const {
 	// 0 denominator means a 'magic' fraction that is not really numeric
 	if (_denominator == 0 || f->_denominator == 0)
 		return null;
-	Fraction* nf = context->stage()->newFraction(_whole - f->_whole, 
-								_numerator * f->_denominator - f->_numerator * _denominator, 
-								_denominator * f->_denominator);
-	nf->normalize(context);
-	return nf;
+	Fraction nf(_whole - f->_whole, 
+				_numerator * f->_denominator - f->_numerator * _denominator, 
+				_denominator * f->_denominator);
+	return nf.normalize(context);
 }
 
 const Term* Fraction::multiply(const Term* operand, Context* context) const {
@@ -3476,11 +3526,8 @@ const Term* Fraction::multiply(const Term* operand, Context* context) const {
 
 	imp0 = _whole * _denominator + _numerator;
 	imp1 = f->_whole * f->_denominator + f->_numerator;
-	Fraction* nf = context->stage()->newFraction(0, 
-							    imp0 * imp1, 
-								_denominator * f->_denominator);
-	nf->normalize(context);
-	return nf;
+	Fraction nf(0, imp0 * imp1, _denominator * f->_denominator);
+	return nf.normalize(context);
 }
 
 const Term* Fraction::divide(const Term* operand, Context* context) const {
@@ -3494,11 +3541,8 @@ const Term* Fraction::divide(const Term* operand, Context* context) const {
 
 	imp0 = _whole * _denominator + _numerator;
 	imp1 = f->_whole * f->_denominator + f->_numerator;
-	Fraction* nf = context->stage()->newFraction(0, 
-							    imp0 * f->_denominator, 
-								_denominator * imp1);
-	nf->normalize(context);
-	return nf;
+	Fraction nf(0, imp0 * f->_denominator, _denominator * imp1);
+	return nf.normalize(context);
 }
 
 const Term* Fraction::remainder(const Term* operand, Context* context) const {
@@ -3575,22 +3619,25 @@ bool Fraction::compare(const Term* operand, int* compareResult) const {
 }
 
 const Fraction* Fraction::normalize(Context* context) const {
-	Fraction* f = context->stage()->newFraction(_whole, _numerator, _denominator);
-	if (_denominator) {
-		if (_denominator < 0) {
-			f->_denominator = -_denominator;
-			f->_numerator = -_numerator;
+	int whole = _whole;
+	int numerator = _numerator;
+	int denominator = _denominator;
+	if (denominator) {
+		if (denominator < 0) {
+			denominator = -denominator;
+			numerator = -numerator;
 		}
-		if (f->_numerator > f->_denominator) {
-			f->_whole += f->_numerator / f->_denominator;
-			f->_numerator %= f->_denominator;
+		if (numerator > denominator) {
+			whole += numerator / denominator;
+			numerator %= denominator;
 		}
-		if (f->_numerator < 0) {
-			f->_numerator += f->_denominator;
-			f->_whole--;
+		if (numerator < 0) {
+			numerator += denominator;
+			whole--;
 		}
 	}
-	return f;
+	// The result comes from the stage, so common values are shared from the grammar's pool
+	return context->stage()->newFraction(whole, numerator, denominator);
 }
 
 void Fraction::token(Token *output) const {
@@ -11,7 +11,30 @@ static void assignAfterCoordinates(vector<Plane*>& planes);
 static bool isBetween(const vector<Rectangle>& boundingBoxes, const Dancer* a, const Dancer* b);
 static Motion* lastCurve(const Dancer* d, const Interval* interval, Context* context);
 static Rotation rotateBy(Rotation r, int n);
-static bool anyOverlapping(const vector<Rectangle>& boundingBoxes);
+static bool initZobristKeys();
+static unsigned __int64 zobristKey(const Dancer* d, int variant);
+static unsigned __int64 zobristKey(int dancerIndex, int x, int y, Facing facing);
+static int shiftCouple(int couple, int shift);
+static bool passesFaceToFace(const vector<const Dancer*>& dancers, int i, int amount);
+static string breathingSignature(const vector<const Group*>& affected, const vector<Rectangle>& boundingBoxes, bool preserveRelativePositions);
+static void solvePlanes(const vector<const Group*>& affected, const vector<Rectangle>& boundingBoxes, bool preserveRelativePositions, vector<int>& deltaX, vector<int>& deltaY);
+
+const int ZOBRIST_DANCERS = 32;			// dancerMask() limits phantom indices to this
+const int ZOBRIST_COORDINATES = 64;		// coordinates wrap, far beyond any real formation
+
+static unsigned __int64 zobristX[ZOBRIST_DANCERS][ZOBRIST_COORDINATES];
+static unsigned __int64 zobristY[ZOBRIST_DANCERS][ZOBRIST_COORDINATES];
+static unsigned __int64 zobristFacing[ZOBRIST_DANCERS][ANY_FACING + 1];
+static bool zobristReady = initZobristKeys();
+
+static const Transform* zobristRotations[] = {
+	&Transform::identity,
+	&Transform::rotate90,
+	&Transform::rotate180,
+	&Transform::rotate270,
+};
+
+const int MAX_BREATHING_SOLUTIONS = 1024;	// a grammar's BreathingSolutions are flushed when they reach this size
 
 bool Group::equals(const Group* dancers) const {
 	if (_rotation != dancers->_rotation ||
@@ -290,79 +313,29 @@ const Group* Group::apply(const Anything* call, Context* context, TileAction til
 
 void Group::breathe(Step* enclosing, vector<const Group*>& affected, unsigned rootMask, const vector<Rectangle>& boundingBoxes, bool preserveRelativePositions, Context* context) const {
 
-		// Now compute the planes
+		// The plane solution depends only on the layout of the tile boxes, so the
+		// same layout always yields the same adjustments.
 
-	vector<Plane*> xPlanes;
-	vector<Plane*> yPlanes;
-
-		// Seed with the center-line planes
-
-	xPlanes.push_back(new Plane(true));
-	yPlanes.push_back(new Plane(true));
-
-	for (int i = 0; i < affected.size(); i++) {
-		unsigned mask = affected[i]->dancerMask();
-		if (mask == 0)
-			continue;
-
-		Rectangle boxNow;
-
-		affected[i]->boundingBox(&boxNow);
-
-		Plane* left;
-		Plane* right;
-		Plane* top;
-		Plane* bottom;
-		Plane* xCenter; 
-		Plane* yCenter;
-		if (preserveRelativePositions && boxNow.coincident(boundingBoxes[i])) {
-			left = new Plane(boundingBoxes[i].left, boxNow.left, i, null);
-			right = new Plane(boundingBoxes[i].right, boxNow.right, i, null);
-			top = new Plane(boundingBoxes[i].top, boxNow.top, i, null);
-			bottom = new Plane(boundingBoxes[i].bottom, boxNow.bottom, i, null);
-		} else {
-			left = new Plane(boxNow.left, boxNow.left, i, null);
-			right = new Plane(boxNow.right, boxNow.right, i, null);
-			top = new Plane(boxNow.top, boxNow.top, i, null);
-			bottom = new Plane(boxNow.bottom, boxNow.bottom, i, null);
-		}
-		xCenter = new Plane(i, null, boxNow.width(), left, right); 
-		yCenter = new Plane(i, null, boxNow.height(), bottom, top);
-		xPlanes.push_back(left);
-		xPlanes.push_back(right);
-		xPlanes.push_back(xCenter);
-		yPlanes.push_back(top);
-		yPlanes.push_back(bottom);
-		yPlanes.push_back(yCenter);
-	}
-
-	xPlanes.sort();
-	yPlanes.sort();
-
-	assignAfterCoordinates(xPlanes);
-	assignAfterCoordinates(yPlanes);
-	if (verboseBreathing) {
-		printf("X Planes:\n");
-		for (int i = 0; i < xPlanes.size(); i++)
-			xPlanes[i]->print(4);
-		printf("Y Planes:\n");
-		for (int i = 0; i < yPlanes.size(); i++)
-			yPlanes[i]->print(4);
-	}
+	BreathingSolutions* solutions = context->grammar()->breathingSolutions();
+	string signature = breathingSignature(affected, boundingBoxes, preserveRelativePositions);
+	const vector<int>* cached = solutions->find(signature);
 
 	vector<int> deltaX;
 	vector<int> deltaY;
 	deltaX.resize(affected.size());
 	deltaY.resize(affected.size());
 
-	for (int i = 0; i < xPlanes.size(); i++)
-		if (xPlanes[i]->lesserEdge)
-			deltaX[xPlanes[i]->tile] = xPlanes[i]->after - xPlanes[i]->now;
-	for (int i = 0; i < yPlanes.size(); i++)
-		if (yPlanes[i]->lesserEdge)
-			deltaY[yPlanes[i]->tile] = yPlanes[i]->after - yPlanes[i]->now;
-	xPlanes.deleteAll();
-	yPlanes.deleteAll();
+	if (cached) {
+		if (verboseBreathing)
+			printf("Re-using breathing solution for %s\n", signature.c_str());
+		for (int i = 0; i < affected.size(); i++) {
+			deltaX[i] = (*cached)[2 * i];
+			deltaY[i] = (*cached)[2 * i + 1];
+		}
+	} else {
+		solvePlanes(affected, boundingBoxes, preserveRelativePositions, deltaX, deltaY);
+		solutions->remember(signature, deltaX, deltaY);
+	}
 
 	// The last step is to copy out the adjustments into 'displace' operations.
 	// Then, combine the tiles into the final dancer set.
@@ -386,6 +359,44 @@ void Group::breathe(Step* enclosing, vector<const Group*>& affected, unsigned ro
 	}
 }
 
+BreathingSolutions::BreathingSolutions() {
+	_count = 0;
+}
+
+BreathingSolutions::~BreathingSolutions() {
+	clear();
+}
+
+const vector<int>* BreathingSolutions::find(const string& layout) {
+	return *_solutions.get(layout);
+}
+
+void BreathingSolutions::remember(const string& layout, const vector<int>& deltaX, const vector<int>& deltaY) {
+	if (_count >= MAX_BREATHING_SOLUTIONS)
+		clear();
+	vector<int>** slot = _solutions.get(layout);
+	if (*slot == null)
+		_count++;
+	else
+		delete *slot;
+	vector<int>* solution = new vector<int>();
+	for (int i = 0; i < deltaX.size(); i++) {
+		solution->push_back(deltaX[i]);
+		solution->push_back(deltaY[i]);
+	}
+	*slot = solution;
+}
+
+void BreathingSolutions::clear() {
+	dictionary<vector<int>*>::iterator i = _solutions.begin();
+	while (i.valid()) {
+		delete *i;
+		i.next();
+	}
+	_solutions.clear();
+	_count = 0;
+}
+
 bool Group::shouldBeRing() const {
 	if (_dancers.size() != 8)
 		return false;
@@ -539,13 +550,30 @@ int Group::buildTiling(const vector<VariantTile>& tiles, TileSearch* out, Contex
 		return -1;
 	}
 
+	// A tiling that starts from some dancer of a symmetric group has a mirror image that starts
+	// from the opposite dancer, so searching from the first half of the dancers finds every
+	// candidate.  Only if the best of the half is not its own mirror image is the whole
+	// group searched.
+	if (exploitSymmetry &&
+		_dancers.size() > 2 &&
+		context->sequence() != null &&
+		isSymmetric(context->sequence()) &&
+		symmetricDesignators(call, step, context)) {
+		int result = searchTiling(tiles, out, context, call, step, tileAction, _dancers.size() / 2);
+		if (result > 0 && symmetricTiling(out, result))
+			return result;
+	}
+	return searchTiling(tiles, out, context, call, step, tileAction, _dancers.size());
+}
+
+int Group::searchTiling(const vector<VariantTile>& tiles, TileSearch* out, Context* context, const Anything* call, Step* step, TileAction tileAction, int startingDancers) const {
 	int bestResult = 0;
 	int bestScore = 0;
 	int dancersInBest = 0;
 	bool unique = true;
 	bool bestSorted = false;
 
-	for (int i = 0; i < _dancers.size(); i++) {
+	for (int i = 0; i < startingDancers; i++) {
 		for (int j = 0; j < tiles.size(); j++) {
 			if (tiles[j].pattern->formation() == null)
 				continue;
@@ -627,6 +655,39 @@ int Group::buildTiling(const vector<VariantTile>& tiles, TileSearch* out, Contex
 		return -1;
 }
 
+bool Group::symmetricDesignators(const Anything* call, const Step* step, Context* context) const {
+	if (call == null)
+		return true;
+	for (int i = 0; i < call->variables().size(); i++) {
+		const Term* v = call->variables()[i];
+		if (typeid(*v) == typeid(Anyone)) {
+			if (step == null)
+				return false;
+			unsigned mask = ((const Anyone*)v)->match(this, step, context);
+			if (oppositeMask(mask) != mask)
+				return false;
+		} else if (typeid(*v) == typeid(Anything)) {
+			if (!symmetricDesignators((const Anything*)v, step, context))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool Group::symmetricTiling(const TileSearch* tiling, int count) const {
+	for (int i = 0; i < count; i++) {
+		unsigned opposite = oppositeMask(tiling[i].dancers->dancerMask());
+		int j;
+		for (j = 0; j < count; j++)
+			if (tiling[j].matched == tiling[i].matched &&
+				tiling[j].dancers->dancerMask() == opposite)
+				break;
+		if (j >= count)
+			return false;
+	}
+	return true;
+}
+
 int Group::buildPhantom4Dancer(const VariantTile& tile, TileSearch* out, Context* context, const Anything* call, Step* step) const {
 	int goalCount = dancerCount();
 	const Group* g = this;
@@ -2155,9 +2216,16 @@ Group* Group::displace(int amount, const Anydirection* direction, Interval* inte
 
 Group* Group::forwardVeer(int amount, int veer, int rightQuarterTurns, Interval* interval, Context* context) const {
 	Group* out = cloneNonDancerData(context);
+	out->carryHashes(this);
 	interval->currentDancers(this);
+	bool passing = _geometry != RING && veer == 0 && rightQuarterTurns == 0 && amount > 0 && amount % 2 == 0;
 	for (int i = 0; i < _dancers.size(); i++) {
-		const Dancer* d = _dancers[i]->forwardVeer(amount, veer, rightQuarterTurns, interval, context);
+		const Dancer* d;
+		if (passing && passesFaceToFace(_dancers, i, amount))
+			d = _dancers[i]->passRightShoulders(amount, interval, context);
+		else
+			d = _dancers[i]->forwardVeer(amount, veer, rightQuarterTurns, interval, context);
+		out->rehash(_dancers[i], d);
 		out->_dancers.push_back(d);
 	}
 	out->done();
@@ -2169,6 +2237,7 @@ Group* Group::arc(const Anypivot* center, const Anydirection* direction, Rotatio
 		return forwardVeer(amount, 0, 0, interval, context);
 	}
 	Group* out = cloneNonDancerData(context);
+	out->carryHashes(this);
 	if (center->pivot() == P_CENTER && amount % 4 != 0) {
 		newRotation = (Rotation)(newRotation + 2 * (amount % 4));
 		if (newRotation >= 8)
@@ -2184,6 +2253,7 @@ Group* Group::arc(const Anypivot* center, const Anydirection* direction, Rotatio
 		if (radius < 0)
 			return null;
 		const Dancer* d = _dancers[i]->arc(_geometry, centerPoint, radius, rightSixteenthTurns, angleAdjust, noseQuarterTurns, interval, context);
+		out->rehash(_dancers[i], d);
 		out->_dancers.push_back(d);
 	}
 	out->_dancers.sort();
@@ -2232,6 +2302,7 @@ Group* Group::face(const Anydirection* dir, const Anypivot* pivot, Interval* int
 	};
 
 	Group* out = cloneNonDancerData(context);
+	out->carryHashes(this);
 	interval->currentDancers(this);
 	for (int i = 0; i < _dancers.size(); i++) {
 		int amount = 0;
@@ -2595,9 +2666,11 @@ Group* Group::face(const Anydirection* dir, const Anypivot* pivot, Interval* int
 		}
 		if (amount == 0)
 			out->insert(_dancers[i]->clone());
-		else if (amount < 2)
-			out->insert(_dancers[i]->face(amount, interval, context));
-		else
+		else if (amount < 2) {
+			const Dancer* d = _dancers[i]->face(amount, interval, context);
+			out->rehash(_dancers[i], d);
+			out->insert(d);
+		} else
 			return null;
 	}
 	return out;
@@ -3023,6 +3096,15 @@ bool Group::isSymmetric(const Sequence* sequence) const {
 	return true;
 }
 
+unsigned Group::oppositeMask(unsigned mask) const {
+	unsigned result = 0;
+	int n = _dancers.size();
+	for (int i = 0; i < n; i++)
+		if (mask & _dancers[i]->dancerMask())
+			result |= _dancers[n - i - 1]->dancerMask();
+	return result;
+}
+
 const Group* Group::disambiguateFromRoot(Context* context) const {
 	Group* g = cloneNonDancerData(context);
 	for (int i = 0; i < _dancers.size(); i++) {
@@ -3088,11 +3170,16 @@ const Group* Group::merge(Context* context) const {
 	if (_dancers.size() == 0)
 		return _base;
 	Group* out = _base->cloneNonDancerData(context);
+	// Without a transform, unchanged base dancers are copied as-is, so only the
+	// substituted dancers need to be folded into the base hashes.
+	if (_transform == null)
+		out->carryHashes(_base);
 	for (int i = 0; i < _base->_dancers.size(); i++) {
 		const Dancer* dancer = _base->_dancers[i];
 		for (int j = 0; j < _dancers.size(); j++) {
 			const Dancer* subsetDancer = _dancers[j];
 			if (dancer->dancerIndex() == subsetDancer->dancerIndex()) {
+				out->rehash(dancer, subsetDancer);
 				dancer = subsetDancer;
 				break;
 			}
@@ -3222,6 +3309,7 @@ const Group* Group::combineSubGroups(vector<const Group*>& groups, Context* cont
 
 Group* Group::clone(Context* context) const {
 	Group* d = cloneNonDancerData(context);
+	d->carryHashes(this);
 	for (int i = 0; i < _dancers.size(); i++)
 		d->_dancers.push_back(_dancers[i]->clone());
 	return d;
@@ -3435,15 +3523,18 @@ void Group::include(const Group* input, unsigned mask) {
 
 void Group::insert(const Dancer* dancer) {
 	_dancers.push_back(dancer);
+	_hashed = false;
 }
 
 void Group::intersection(const Group* x, unsigned mask) {
+	_hashed = false;
 	for (int i = 0; i < x->_dancers.size(); i++)
 		if (mask & x->_dancers[i]->dancerMask())
 			_dancers.push_back(x->_dancers[i]->clone());
 }
 
 void Group::subtraction(const Group* x, unsigned mask) {
+	_hashed = false;
 	for (int i = 0; i < x->_dancers.size(); i++)
 		if ((mask & x->_dancers[i]->dancerMask()) == 0)
 			_dancers.push_back(x->_dancers[i]->clone());
@@ -3455,6 +3546,188 @@ void Group::done() {
 
 void Group::clear() {
 	_dancers.clear();
+	_hashed = false;
+}
+
+unsigned __int64 Group::hash() const {
+	if (!_hashed)
+		computeHashes();
+	return _hashes[0];
+}
+
+bool Group::hashesCurrent() const {
+	if (!_hashed)
+		return true;
+	unsigned __int64 carried[ZOBRIST_VARIANTS];
+	memcpy(carried, _hashes, sizeof carried);
+	computeHashes();
+	return memcmp(carried, _hashes, sizeof carried) == 0;
+}
+
+unsigned __int64 Group::rotationInvariantHash() const {
+	if (!_hashed)
+		computeHashes();
+	unsigned __int64 h = _hashes[0];
+	for (int i = 1; i < 4; i++)
+		if (_hashes[i] < h)
+			h = _hashes[i];
+	return h;
+}
+
+unsigned __int64 Group::mirrorInvariantHash() const {
+	if (!_hashed)
+		computeHashes();
+	unsigned __int64 h = _hashes[0];
+	for (int i = 1; i < ZOBRIST_VARIANTS; i++)
+		if (_hashes[i] < h)
+			h = _hashes[i];
+	return h;
+}
+
+unsigned __int64 Group::canonicalHash(bool mirrors, Symmetry* symmetry) const {
+	int variants = 1;
+	if (_geometry == GRID)
+		variants = mirrors ? ZOBRIST_VARIANTS : 4;
+	int shifts = COUPLE_SHIFTS;
+	for (int i = 0; i < _dancers.size(); i++)
+		if (_dancers[i]->couple > COUPLE_SHIFTS)
+			shifts = 1;
+
+	// Each dancer is transformed once per variant, then keyed once per couple shift.
+
+	unsigned __int64 hashes[ZOBRIST_VARIANTS][COUPLE_SHIFTS];
+	memset(hashes, 0, sizeof hashes);
+	for (int i = 0; i < _dancers.size(); i++) {
+		const Dancer* d = _dancers[i];
+		for (int v = 0; v < variants; v++) {
+			int x = d->x;
+			int y = d->y;
+			Facing facing = d->facing;
+			if (v >= 4)
+				Transform::mirror.apply(&x, &y, &facing);
+			zobristRotations[v & 3]->apply(&x, &y, &facing);
+			for (int s = 0; s < shifts; s++) {
+				int index = d->couple ? dancerIdx(shiftCouple(d->couple, s), d->gender) : d->dancerIndex();
+				hashes[v][s] ^= zobristKey(index, x, y, facing);
+			}
+		}
+	}
+	int bestV = 0;
+	int bestS = 0;
+	for (int v = 0; v < variants; v++)
+		for (int s = 0; s < shifts; s++)
+			if (hashes[v][s] < hashes[bestV][bestS]) {
+				bestV = v;
+				bestS = s;
+			}
+	if (symmetry) {
+		symmetry->mirrored = bestV >= 4;
+		symmetry->leftQuarterTurns = bestV & 3;
+		symmetry->coupleShift = bestS;
+	}
+	return hashes[bestV][bestS];
+}
+
+unsigned __int64 Group::canonicalHash(const Symmetry* symmetries, int count, Symmetry* symmetry) const {
+	bool relabel = true;
+	for (int i = 0; i < _dancers.size(); i++)
+		if (_dancers[i]->couple > COUPLE_SHIFTS)
+			relabel = false;
+	unsigned __int64 best = hash();
+	Symmetry chosen;
+	for (int i = 0; i < count; i++) {
+		const Symmetry& s = symmetries[i];
+		if ((s.mirrored || s.leftQuarterTurns) && _geometry != GRID)
+			continue;
+		if (s.coupleShift && !relabel)
+			continue;
+		unsigned __int64 h = hash(s);
+		if (h < best) {
+			best = h;
+			chosen = s;
+		}
+	}
+	if (symmetry)
+		*symmetry = chosen;
+	return best;
+}
+
+unsigned __int64 Group::hash(const Symmetry& symmetry) const {
+	unsigned __int64 h = 0;
+	for (int i = 0; i < _dancers.size(); i++) {
+		const Dancer* d = _dancers[i];
+		int x = d->x;
+		int y = d->y;
+		Facing facing = d->facing;
+		if (symmetry.mirrored)
+			Transform::mirror.apply(&x, &y, &facing);
+		zobristRotations[symmetry.leftQuarterTurns & 3]->apply(&x, &y, &facing);
+		int index = d->couple ? dancerIdx(shiftCouple(d->couple, symmetry.coupleShift), d->gender) : d->dancerIndex();
+		h ^= zobristKey(index, x, y, facing);
+	}
+	return h;
+}
+
+Group* Group::canonical(bool mirrors, Symmetry* symmetry, Context* context) const {
+	Symmetry s;
+	canonicalHash(mirrors, &s);
+	if (symmetry)
+		*symmetry = s;
+	return applySymmetry(s, context);
+}
+
+Group* Group::applySymmetry(const Symmetry& symmetry, Context* context) const {
+	Group* g = context->stage()->newGroup(_homeGeometry);
+	g->_geometry = _geometry;
+	g->_rotation = _rotation;
+	for (int i = 0; i < _dancers.size(); i++) {
+		const Dancer* d = _dancers[i];
+		int x = d->x;
+		int y = d->y;
+		Facing facing = d->facing;
+		if (symmetry.mirrored)
+			Transform::mirror.apply(&x, &y, &facing);
+		zobristRotations[symmetry.leftQuarterTurns & 3]->apply(&x, &y, &facing);
+		if (d->couple) {
+			int couple = shiftCouple(d->couple, symmetry.coupleShift);
+			g->insert(new Dancer(x, y, facing, d->gender, couple));
+		} else
+			g->insert(new Dancer(x, y, facing, d->gender, 0, d->dancerIndex()));
+	}
+	g->done();
+	return g;
+}
+
+void Group::computeHashes() const {
+	for (int v = 0; v < ZOBRIST_VARIANTS; v++) {
+		_hashes[v] = 0;
+		for (int i = 0; i < _dancers.size(); i++)
+			_hashes[v] ^= zobristKey(_dancers[i], v);
+	}
+	_hashed = true;
+}
+/*
+ *	carryHashes
+ *
+ *	Start this (empty) group with the hashes of source, so that the caller can
+ *	rehash just the dancers it changes.  Nothing happens if source was never hashed.
+ */
+void Group::carryHashes(const Group* source) {
+	_hashed = source->_hashed;
+	if (_hashed)
+		memcpy(_hashes, source->_hashes, sizeof _hashes);
+}
+
+void Group::rehash(const Dancer* before, const Dancer* after) {
+	if (!_hashed)
+		return;
+	if (before->x == after->x &&
+		before->y == after->y &&
+		before->facing == after->facing &&
+		before->dancerIndex() == after->dancerIndex())
+		return;
+	for (int v = 0; v < ZOBRIST_VARIANTS; v++)
+		_hashes[v] ^= zobristKey(before, v) ^ zobristKey(after, v);
 }
 
 void Group::buildDancerArray(const Dancer** output) const {
@@ -3810,7 +4083,9 @@ Motion* lastCurve(const Dancer* d, const Interval* interval, Context* context) {
 	if (sequence == null)
 		return null;
 	for (int i = 0; i < sequence->stages().size(); i++) {
-		if (context->stage() == sequence->stages()[i]) {
+		// A replayed stage must see the same prior motions as the stage it replays.
+		if (context->stage() == sequence->stages()[i] ||
+			context->stage() == sequence->stages()[i]->replay()) {
 			while (i > 0) {
 				const Stage* s = sequence->stages()[i - 1];
 				return s->motions()->lastCurve(d->dancerIndex(), true);
@@ -3820,20 +4095,188 @@ Motion* lastCurve(const Dancer* d, const Interval* interval, Context* context) {
 	return null;
 }
 
+static string breathingSignature(const vector<const Group*>& affected, const vector<Rectangle>& boundingBoxes, bool preserveRelativePositions) {
+	string signature(preserveRelativePositions ? "p" : "n");
+	for (int i = 0; i < affected.size(); i++) {
+		if (affected[i]->dancerMask() == 0) {
+			signature = signature + ";";
+			continue;
+		}
+		Rectangle boxNow;
+		affected[i]->boundingBox(&boxNow);
+		Rectangle boxBefore = boxNow;
+		if (preserveRelativePositions && boxNow.coincident(boundingBoxes[i]))
+			boxBefore = boundingBoxes[i];
+		signature = signature + ";" + string(boxBefore.left) + "," + string(boxBefore.right) + "," +
+								string(boxBefore.top) + "," + string(boxBefore.bottom) + "/" +
+								string(boxNow.left) + "," + string(boxNow.right) + "," +
+								string(boxNow.top) + "," + string(boxNow.bottom);
+	}
+	return signature;
+}
+
+static void solvePlanes(const vector<const Group*>& affected, const vector<Rectangle>& boundingBoxes, bool preserveRelativePositions, vector<int>& deltaX, vector<int>& deltaY) {
+		// Now compute the planes.  Each axis gets one flat array holding the center
+		// line plus three planes per tile, so there is one allocation per axis.
+
+	int planeCount = 1 + 3 * affected.size();
+	Plane* xStorage = new Plane[planeCount];
+	Plane* yStorage = new Plane[planeCount];
+	vector<Plane*> xPlanes;
+	vector<Plane*> yPlanes;
+
+		// Seed with the center-line planes
+
+	xStorage[0].setCenterLine();
+	yStorage[0].setCenterLine();
+	xPlanes.push_back(&xStorage[0]);
+	yPlanes.push_back(&yStorage[0]);
+	int used = 1;
+
+	for (int i = 0; i < affected.size(); i++) {
+		unsigned mask = affected[i]->dancerMask();
+		if (mask == 0)
+			continue;
+
+		Rectangle boxNow;
+
+		affected[i]->boundingBox(&boxNow);
+
+		Plane* left = &xStorage[used];
+		Plane* right = &xStorage[used + 1];
+		Plane* xCenter = &xStorage[used + 2];
+		Plane* top = &yStorage[used];
+		Plane* bottom = &yStorage[used + 1];
+		Plane* yCenter = &yStorage[used + 2];
+		used += 3;
+		if (preserveRelativePositions && boxNow.coincident(boundingBoxes[i])) {
+			left->setEdge(boundingBoxes[i].left, boxNow.left, i, null);
+			right->setEdge(boundingBoxes[i].right, boxNow.right, i, null);
+			top->setEdge(boundingBoxes[i].top, boxNow.top, i, null);
+			bottom->setEdge(boundingBoxes[i].bottom, boxNow.bottom, i, null);
+		} else {
+			left->setEdge(boxNow.left, boxNow.left, i, null);
+			right->setEdge(boxNow.right, boxNow.right, i, null);
+			top->setEdge(boxNow.top, boxNow.top, i, null);
+			bottom->setEdge(boxNow.bottom, boxNow.bottom, i, null);
+		}
+		xCenter->setCenter(i, null, boxNow.width(), left, right); 
+		yCenter->setCenter(i, null, boxNow.height(), bottom, top);
+		xPlanes.push_back(left);
+		xPlanes.push_back(right);
+		xPlanes.push_back(xCenter);
+		yPlanes.push_back(top);
+		yPlanes.push_back(bottom);
+		yPlanes.push_back(yCenter);
+	}
+
+	xPlanes.sort();
+	yPlanes.sort();
+
+	assignAfterCoordinates(xPlanes);
+	assignAfterCoordinates(yPlanes);
+	if (verboseBreathing) {
+		printf("X Planes:\n");
+		for (int i = 0; i < xPlanes.size(); i++)
+			xPlanes[i]->print(4);
+		printf("Y Planes:\n");
+		for (int i = 0; i < yPlanes.size(); i++)
+			yPlanes[i]->print(4);
+	}
+
+	for (int i = 0; i < xPlanes.size(); i++)
+		if (xPlanes[i]->lesserEdge)
+			deltaX[xPlanes[i]->tile] = xPlanes[i]->after - xPlanes[i]->now;
+	for (int i = 0; i < yPlanes.size(); i++)
+		if (yPlanes[i]->lesserEdge)
+			deltaY[yPlanes[i]->tile] = yPlanes[i]->after - yPlanes[i]->now;
+	delete [] xStorage;
+	delete [] yStorage;
+}
+
 static bool isBetween(const vector<Rectangle>& boundingBoxes, const Dancer* a, const Dancer* b) {
 	for (int i = 0; i < boundingBoxes.size(); i++)
 		if (boundingBoxes[i].isBetween(a, b))
 			return true;
 	return false;
 }
-
-static bool anyOverlapping(const vector<Rectangle>& boundingBoxes) {
-	for (int i = 0; i < boundingBoxes.size(); i++) {
-		for (int j = i + 1; j < boundingBoxes.size(); j++) {
-			if (boundingBoxes[i].overlaps(boundingBoxes[j]))
-				return true;
+/*
+ *	initZobristKeys
+ *
+ *	The keys come from a fixed-seed generator so that hashes are reproducible
+ *	from one run to the next.
+ */
+static bool initZobristKeys() {
+	unsigned __int64 seed = 0x9e3779b97f4a7c15;
+
+	for (int i = 0; i < ZOBRIST_DANCERS; i++) {
+		for (int j = 0; j < ZOBRIST_COORDINATES; j++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			zobristX[i][j] = seed;
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			zobristY[i][j] = seed;
+		}
+		for (int j = 0; j <= ANY_FACING; j++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			zobristFacing[i][j] = seed;
 		}
 	}
+	return true;
+}
+
+static unsigned __int64 zobristKey(const Dancer* d, int variant) {
+	int x = d->x;
+	int y = d->y;
+	Facing facing = d->facing;
+	if (variant >= 4)
+		Transform::mirror.apply(&x, &y, &facing);
+	zobristRotations[variant & 3]->apply(&x, &y, &facing);
+	return zobristKey(d->dancerIndex(), x, y, facing);
+}
+
+static unsigned __int64 zobristKey(int dancerIndex, int x, int y, Facing facing) {
+	int i = dancerIndex & (ZOBRIST_DANCERS - 1);
+	return zobristX[i][x & (ZOBRIST_COORDINATES - 1)] ^
+		   zobristY[i][y & (ZOBRIST_COORDINATES - 1)] ^
+		   zobristFacing[i][facing];
+}
+
+static int shiftCouple(int couple, int shift) {
+	return ((couple - 1 + shift) & (COUPLE_SHIFTS - 1)) + 1;
+}
+/*
+ *	passesFaceToFace
+ *
+ *	True if some other dancer stands ahead of dancers[i] on its line, facing it, close
+ *	enough that the two walk through each other when both move forward amount.  A dancer
+ *	exactly twice amount away is met nose to nose instead, and is not passed.
+ */
+static bool passesFaceToFace(const vector<const Dancer*>& dancers, int i, int amount) {
+	const Dancer* d = dancers[i];
+	int forwardX, forwardY;
+
+	if (d->facing > FRONT_FACING)
+		return false;
+	d->displace(1, 0, &forwardX, &forwardY);
+	Facing opposite = reverse(d->facing);
+	for (int j = 0; j < dancers.size(); j++) {
+		const Dancer* other = dancers[j];
+		if (j == i || other->facing != opposite)
+			continue;
+		int dx = other->x - d->x;
+		int dy = other->y - d->y;
+		if (dx * forwardY != dy * forwardX)
+			continue;
+		int ahead = dx * forwardX + dy * forwardY;
+		if (ahead > 0 && ahead < 2 * amount)
+			return true;
+	}
 	return false;
 }
 
@@ -0,0 +1,241 @@
+#include "../common/platform.h"
+#include "modules.h"
+
+#include "../common/timing.h"
+#include "call.h"
+
+namespace dance {
+/*
+ *	ModuleNode
+ *
+ *	One position reached by the search, with the call that reached it from its
+ *	parent.  The stage is kept for the whole search, since the stages of the calls
+ *	performed from this position start from its final group.
+ *
+ *	A node with no stage only records a sequence of calls: one reaching a position
+ *	already seen or its half turn, or one reaching the goal or its half turn.
+ */
+class ModuleNode {
+public:
+	ModuleNode(ModuleNode* parent, int call, Stage* stage, const Group* dancers) {
+		this->parent = parent;
+		this->call = call;
+		this->stage = stage;
+		this->dancers = dancers;
+		depth = parent ? parent->depth + 1 : 0;
+		symmetric = false;
+	}
+
+	~ModuleNode() {
+		delete stage;
+	}
+
+	ModuleNode*		parent;
+	int				call;			// index in the candidates, -1 for the start
+	Stage*			stage;			// null for the start
+	const Group*	dancers;
+	int				depth;			// calls from the start
+	bool			symmetric;		// the position is its own half turn
+	vector<const ModuleNode*> repeats;	// later sequences reaching this position
+	vector<const ModuleNode*> turns;	// sequences reaching a half turn of this position
+};
+
+static const Symmetry moduleSymmetries[] = {
+	Symmetry(false, 2, 2),
+};
+
+ModuleFinder::ModuleFinder(const Grammar* grammar, Level level) : CallSearch(grammar, level) {
+	_positions = 0;
+}
+
+ModuleFinder::ModuleFinder(const CandidateCalls* candidates) : CallSearch(candidates) {
+	_positions = 0;
+}
+
+ModuleFinder::~ModuleFinder() {
+	_modules.deleteAll();
+}
+
+int ModuleFinder::findZeros(const Group* start, int maxCalls, int milliseconds) {
+	timing::Timer t("ModuleFinder::findZeros");
+	startClock(milliseconds);
+	search(start, start, null, maxCalls);
+	return _modules.size();
+}
+
+int ModuleFinder::findEquivalents(const Group* start, const vector<string>& target, int maxCalls, int milliseconds) {
+	timing::Timer t("ModuleFinder::findEquivalents");
+	startClock(milliseconds);
+	vector<Stage*> stages;
+	const Group* dancers = start;
+	for (int i = 0; i < target.size(); i++) {
+		Stage* stage = perform(dancers, target[i]);
+		if (stage == null) {
+			stages.deleteAll();
+			_modules.deleteAll();
+			return -1;
+		}
+		stages.push_back(stage);
+		dancers = stage->final();
+	}
+	search(start, dancers, &target, maxCalls);
+	stages.deleteAll();
+	return _modules.size();
+}
+
+void ModuleFinder::search(const Group* start, const Group* goal, const vector<string>* excluded, int maxCalls) {
+	_modules.deleteAll();
+	_positions = 1;
+	string goalKey = positionKey(goal);
+	string turnedGoalKey = turnedKey(goal);
+	bool symmetricGoal = goalKey == turnedGoalKey;
+	vector<ModuleNode*> nodes;
+	vector<ModuleNode*> records;				// the nodes with no stage
+	vector<const ModuleNode*> hits;				// sequences reaching the goal
+	vector<const ModuleNode*> turnedHits;		// sequences reaching the half turn of the goal
+	dictionary<ModuleNode*> seen;
+	nodes.push_back(new ModuleNode(null, -1, null, start));
+	nodes[0]->symmetric = positionKey(start) == turnedKey(start);
+	*seen.get(symmetryKey(start)) = nodes[0];
+	int layerStart = 0;
+	for (int depth = 1; depth <= maxCalls && !expired(); depth++) {
+		int layerEnd = nodes.size();
+		for (int i = layerStart; i < layerEnd && hits.size() + turnedHits.size() < MODULE_MAX_RESULTS && !expired(); i++) {
+			ModuleNode* n = nodes[i];
+			for (int c = 0; c < _candidates.size() && hits.size() + turnedHits.size() < MODULE_MAX_RESULTS && !expired(); c++) {
+				Stage* stage = perform(n->dancers, c);
+				if (stage == null)
+					continue;
+				string key = positionKey(stage->final());
+				if (key == goalKey) {
+					ModuleNode* hit = new ModuleNode(n, c, null, null);
+					records.push_back(hit);
+					hits.push_back(hit);
+				} else if (key == turnedGoalKey) {
+					ModuleNode* hit = new ModuleNode(n, c, null, null);
+					records.push_back(hit);
+					turnedHits.push_back(hit);
+				}
+				ModuleNode** known = seen.get(symmetryKey(stage->final()));
+				if (*known) {
+
+					// The position, or its half turn, was reached before.  This sequence
+					// can stand in for the first in any sequence through it, so it is
+					// kept unless it is already as long as a sequence can be.
+
+					if (depth < maxCalls) {
+						ModuleNode* record = new ModuleNode(n, c, null, null);
+						records.push_back(record);
+						if (key == positionKey((*known)->dancers))
+							(*known)->repeats.push_back(record);
+						else
+							(*known)->turns.push_back(record);
+					}
+					delete stage;
+					continue;
+				}
+				if (depth == maxCalls) {
+					delete stage;
+					continue;
+				}
+				ModuleNode* child = new ModuleNode(n, c, stage, stage->final());
+				child->symmetric = key == turnedKey(stage->final());
+				*known = child;
+				nodes.push_back(child);
+				_positions++;
+			}
+		}
+		layerStart = layerEnd;
+	}
+	vector<int> suffix;
+	for (int i = 0; i < hits.size(); i++) {
+		suffix.push_back(hits[i]->call);
+		report(hits[i]->parent, false, &suffix, maxCalls - 1, excluded);
+		suffix.clear();
+	}
+	if (!symmetricGoal) {
+		for (int i = 0; i < turnedHits.size(); i++) {
+			suffix.push_back(turnedHits[i]->call);
+			report(turnedHits[i]->parent, true, &suffix, maxCalls - 1, excluded);
+			suffix.clear();
+		}
+	}
+
+	// A child's stage starts from its parent's final group, but a Stage does not
+	// delete its start group, so the nodes can be deleted in any order.
+
+	nodes.deleteAll();
+	records.deleteAll();
+}
+
+void ModuleFinder::addModule(CallList* m, const vector<string>* excluded) {
+	bool same = excluded != null && excluded->size() == m->calls.size();
+	for (int j = 0; same && j < m->calls.size(); j++)
+		if (m->calls[j] != (*excluded)[j])
+			same = false;
+	if (same || _modules.size() >= MODULE_MAX_RESULTS)
+		delete m;
+	else
+		_modules.push_back(m);
+}
+
+/*
+ *	The first sequence to reach a position is the shortest, so no sequence shorter than
+ *	a node's depth reaches it or its half turn.
+ *
+ *	Each sequence is reached exactly once: its last call was performed from the one
+ *	node whose position, or half turn, its other calls reach.  What that call led to
+ *	is either the node's child or one of the records kept with a node.
+ */
+void ModuleFinder::report(const ModuleNode* n, bool turned, vector<int>* suffix, int budget, const vector<string>* excluded) {
+	if (n->depth > budget || _modules.size() >= MODULE_MAX_RESULTS)
+		return;
+	if (n->symmetric)
+		turned = false;
+	if (n->parent == null) {
+		if (!turned) {
+			CallList* m = new CallList;
+			for (int i = suffix->size() - 1; i >= 0; i--)
+				m->calls.push_back(_candidates[(*suffix)[i]]);
+			addModule(m, excluded);
+		}
+	} else {
+		suffix->push_back(n->call);
+		report(n->parent, turned, suffix, budget - 1, excluded);
+		suffix->resize(suffix->size() - 1);
+	}
+	for (int i = 0; i < n->repeats.size(); i++) {
+		suffix->push_back(n->repeats[i]->call);
+		report(n->repeats[i]->parent, turned, suffix, budget - 1, excluded);
+		suffix->resize(suffix->size() - 1);
+	}
+	for (int i = 0; i < n->turns.size(); i++) {
+		suffix->push_back(n->turns[i]->call);
+		report(n->turns[i]->parent, !turned, suffix, budget - 1, excluded);
+		suffix->resize(suffix->size() - 1);
+	}
+}
+/*
+ *	symmetryKey
+ *
+ *	As positionKey, but the same for a position and its half turn.
+ */
+string ModuleFinder::symmetryKey(const Group* dancers) {
+	string key;
+
+	key.printf("%I64x:%d:%d", dancers->canonicalHash(moduleSymmetries, dimOf(moduleSymmetries), null), int(dancers->geometry()), int(dancers->rotation()));
+	return key;
+}
+/*
+ *	turnedKey
+ *
+ *	The positionKey of the half turn of the dancers.
+ */
+string ModuleFinder::turnedKey(const Group* dancers) {
+	string key;
+
+	key.printf("%I64x:%d:%d", dancers->hash(moduleSymmetries[0]), int(dancers->geometry()), int(dancers->rotation()));
+	return key;
+}
+
+}  // namespace dance
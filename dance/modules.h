@@ -0,0 +1,75 @@
+#pragma once
+#include "resolve.h"
+
+namespace dance {
+
+class ModuleNode;
+
+const int MODULE_MAX_CALLS = 3;
+const int MODULE_MAX_RESULTS = 50;
+const int MODULE_MILLISECONDS = RESOLVE_MILLISECONDS;	// the SequenceEditor waits for a search on the UI thread
+/*
+ *	ModuleFinder
+ *
+ *	Enumerates short call sequences that are modules from a starting position.  A zero
+ *	leaves every dancer where, and facing as, they started.  An equivalent leaves the
+ *	dancers exactly as a given list of target calls does.
+ *
+ *	Positions are explored breadth first: every sequence of one call, then of two, and
+ *	so on.  Each distinct position (by positionKey) is expanded only from the first,
+ *	shortest, sequence that reached it.  A later sequence arriving at a position already
+ *	seen goes no further, but is recorded with that position.  Once the search is done,
+ *	each sequence that reached the position sought is reported with every recorded
+ *	sequence that can stand in for a part of it, so every module of at most maxCalls
+ *	calls is listed.
+ *
+ *	A half turn of the square, with each couple taking the number of the couple
+ *	opposite, changes no call: heads are still heads, and partners, corners and home
+ *	spots go with the dancers.  So a position that is a half turn of one already seen
+ *	is not expanded either, and is recorded the same way.  Sequences through it are
+ *	found from the position seen, as sequences reaching the half turn of the position
+ *	sought.  Quarter turns trade the heads for the sides, and mirrors trade left for
+ *	right, so they are not used.
+ */
+class ModuleFinder : public CallSearch {
+public:
+	ModuleFinder(const Grammar* grammar, Level level);
+
+	ModuleFinder(const CandidateCalls* candidates);
+
+	~ModuleFinder();
+
+	int findZeros(const Group* start, int maxCalls, int milliseconds);
+	/*
+	 *	findEquivalents
+	 *
+	 *	Performs the target calls from start and looks for other sequences that end the
+	 *	same way.  The target itself is not reported.  Returns -1 if a target call fails.
+	 */
+	int findEquivalents(const Group* start, const vector<string>& target, int maxCalls, int milliseconds);
+
+	const vector<CallList*>& modules() const { return _modules; }
+
+	int positions() const { return _positions; }
+
+private:
+	void search(const Group* start, const Group* goal, const vector<string>* excluded, int maxCalls);
+
+	void addModule(CallList* m, const vector<string>* excluded);
+	/*
+	 *	report
+	 *
+	 *	Reports each sequence of at most budget calls that reaches the position of node n,
+	 *	or its half turn if turned, followed by the calls in suffix (last call first).
+	 */
+	void report(const ModuleNode* n, bool turned, vector<int>* suffix, int budget, const vector<string>* excluded);
+
+	static string symmetryKey(const Group* dancers);
+
+	static string turnedKey(const Group* dancers);
+
+	vector<CallList*>	_modules;
+	int					_positions;		// distinct positions reached by the last search
+};
+
+}  // namespace dance
@@ -8,6 +8,9 @@
 
 namespace dance {
 
+static void gatherVariants(const Plan* p, vector<VariantTile>* output);
+static bool gatherVariant(const Plan* p, vector<VariantTile>* output);
+
 Motion* Interval::lastCurve(const Dancer* dancer, bool lastMotionOnly) const {
 	Motion* m = MotionSet::lastCurve(dancer->dancerIndex(), lastMotionOnly);
 	if (m)
@@ -222,11 +225,19 @@ void MotionSet::printCommon(int indent) const {
 		printf("%*.*c<remembered>\n", indent, indent, ' ');
 }
 
-Stage::Stage(const Sequence* sequence, const Group* start) : Plan(start, null, null), _motions(false) {
+Stage::Stage(const Sequence* sequence, const Group* start, const TermPool* termPool) : Plan(start, null, null), _motions(false) {
 	_sequence = sequence;
+	_termPool = termPool;
+	_pruned = false;
+	_replay = null;
+	_variantsGathered = false;
 }
 
 Stage::~Stage() {
+	if (_replay) {
+		deletingStage.fire(_replay);
+		delete _replay;
+	}
 	_plans.deleteAll();
 	_steps.deleteAll();
 	_tiles.deleteAll();
@@ -234,6 +245,7 @@ Stage::~Stage() {
 	_terms.deleteAll();
 	_explanations.deleteAll();
 	_allocedMotions.deleteAll();
+	_timelines.deleteAll();
 }
 
 bool Stage::inStage(Stage* stage) const {
@@ -247,12 +259,325 @@ void Stage::collectMotions() {
 	Plan::collectMotions(~0, &_motions, &context);
 	if (!_motions.validate(_start, _resolution.final()))
 		fail(newExplanation(PROGRAM_BUG, "Motions are not valid"));
+	_timelines.deleteAll();
+	_timelines.clear();
+	for (int i = 0; i < _motions.dancerCount(); i++)
+		_timelines.push_back(new MotionTimeline(_motions.motion(i)));
+}
+
+const Motion* Stage::activeMotion(int index, double partial) const {
+	if (index < _timelines.size())
+		return _timelines[index]->active(partial);
+	for (const Motion* m = motion(index); m; m = m->previous())
+		if (m->startAt() < partial)
+			return m;
+	return null;
+}
+
+void Stage::prune(fileSystem::TimeStamp grammarVersion) {
+	timing::Timer t("Stage::prune");
+	variantsApplied();
+	_pruned = true;
+	_grammarVersion = grammarVersion;
+	Plan::_steps.clear();
+	delete _interval;
+	_interval = null;
+	_orientedStart = _start;
+	_resolution.retainFinalOnly();
+	_plans.deleteAll();
+	_steps.deleteAll();
+	_tiles.deleteAll();
+
+	// The final group may be expressed relative to other groups of this stage,
+	// so keep its chain of bases and discard everything else.
+
+	int kept = 0;
+	for (int i = 0; i < _dancers.size(); i++) {
+		Group* g = _dancers[i];
+		bool needed = false;
+		for (const Group* b = final(); b != null; b = b->base())
+			if (b == g) {
+				needed = true;
+				break;
+			}
+		if (needed)
+			_dancers[kept++] = g;
+		else
+			delete g;
+	}
+	_dancers.resize(kept);
+}
+
+const vector<VariantTile>& Stage::variantsApplied() const {
+	if (!_variantsGathered) {
+		_variantsGathered = true;
+		if (!_pruned && !failed())
+			gatherVariants(this, &_variantsApplied);
+	}
+	return _variantsApplied;
+}
+
+void Stage::useDefinition(const Definition* definition) {
+	for (int i = 0; i < _definitionsUsed.size(); i++)
+		if (_definitionsUsed[i] == definition)
+			return;
+	_definitionsUsed.push_back(definition);
 }
 
 void Stage::checkFlow(FlowState* flowState) {
 	timing::Timer t("Stage::checkFlow");
 	_motions.checkFlow(flowState, this);
 }
+/*
+ *	SweptPath
+ *
+ *	One dancer's position sampled COLLISION_SAMPLES_PER_BEAT times a beat through a
+ *	stage.  Between samples the path is treated as a straight segment.
+ */
+class SweptPath {
+public:
+	void sample(const Stage* stage, int dancerIndex, int samples);
+	/*
+	 *	bounds
+	 *
+	 *	The box swept between samples first and last, grown by half the collision
+	 *	distance.  Returns false if the dancer has no motion at all in that span.
+	 */
+	bool bounds(int first, int last, double* left, double* right, double* bottom, double* top) const;
+
+	bool located(int k) const { return _located[k] != 0; }
+
+	double x(int k) const { return _x[k]; }
+
+	double y(int k) const { return _y[k]; }
+
+	double nose(int k) const { return _nose[k]; }
+
+private:
+	vector<double>	_x;
+	vector<double>	_y;
+	vector<double>	_nose;
+	vector<int>		_located;
+};
+
+class SweptBox {
+public:
+	int		dancerIndex;
+	double	left;
+	double	right;
+	double	bottom;
+	double	top;
+};
+
+static bool collide(const SweptPath& a, const SweptPath& b, int first, int last, int* at);
+static bool passing(const SweptPath& a, const SweptPath& b, int k, double cx, double cy);
+static bool walkingForward(const SweptPath& path, int k);
+static bool turningTogether(const Motion* a, const Motion* b);
+
+void Stage::checkCollisions() {
+	timing::Timer t("Stage::checkCollisions");
+	int dancerCount = _motions.dancerCount();
+	if (dancerCount > MAX_DANCERS)
+		dancerCount = MAX_DANCERS;
+	int samples = duration() * COLLISION_SAMPLES_PER_BEAT;
+	if (dancerCount < 2 || samples == 0)
+		return;
+	SweptPath paths[MAX_DANCERS];
+	for (int i = 0; i < dancerCount; i++)
+		paths[i].sample(this, i, samples);
+
+	unsigned reported[MAX_DANCERS];
+	for (int i = 0; i < dancerCount; i++)
+		reported[i] = 0;
+
+	// Sweep and prune one beat at a time: sort the swept boxes by left edge, and only
+	// boxes that overlap in both x and y go on to the segment distance test.
+
+	for (int first = 0; first < samples; first += COLLISION_SAMPLES_PER_BEAT) {
+		int last = first + COLLISION_SAMPLES_PER_BEAT;
+		if (last > samples)
+			last = samples;
+		SweptBox boxes[MAX_DANCERS];
+		int boxCount = 0;
+		for (int i = 0; i < dancerCount; i++) {
+			SweptBox box;
+			if (!paths[i].bounds(first, last, &box.left, &box.right, &box.bottom, &box.top))
+				continue;
+			box.dancerIndex = i;
+			int j = boxCount++;
+			for (; j > 0 && boxes[j - 1].left > box.left; j--)
+				boxes[j] = boxes[j - 1];
+			boxes[j] = box;
+		}
+		for (int a = 0; a < boxCount; a++) {
+			for (int b = a + 1; b < boxCount && boxes[b].left <= boxes[a].right; b++) {
+				if (boxes[b].bottom > boxes[a].top || boxes[b].top < boxes[a].bottom)
+					continue;
+				int i = boxes[a].dancerIndex;
+				int j = boxes[b].dancerIndex;
+				if (reported[i] & (1 << j))
+					continue;
+				int at;
+				if (collide(paths[i], paths[j], first, last, &at)) {
+					double partial = at ? double(at) / COLLISION_SAMPLES_PER_BEAT : EPSILON;
+					if (turningTogether(activeMotion(i, partial), activeMotion(j, partial)))
+						continue;
+					reported[i] |= 1 << j;
+					reported[j] |= 1 << i;
+					warn(newExplanation(DEFINITION_ERROR, string(genderNames[genderOf(i)]) + " #" + coupleOf(i) + 
+												   " runs into " + genderNames[genderOf(j)] + " #" + coupleOf(j) + 
+												   " at beat " + (at / COLLISION_SAMPLES_PER_BEAT)));
+				}
+			}
+		}
+	}
+}
+
+void SweptPath::sample(const Stage* stage, int dancerIndex, int samples) {
+	_x.resize(samples + 1);
+	_y.resize(samples + 1);
+	_nose.resize(samples + 1);
+	_located.resize(samples + 1);
+	for (int k = 0; k <= samples; k++) {
+		double partial = k ? double(k) / COLLISION_SAMPLES_PER_BEAT : EPSILON;
+		_located[k] = locateMotion(stage->activeMotion(dancerIndex, partial), partial, &_x[k], &_y[k], &_nose[k]);
+	}
+}
+
+bool SweptPath::bounds(int first, int last, double* left, double* right, double* bottom, double* top) const {
+	bool any = false;
+	for (int k = first; k <= last; k++) {
+		if (!_located[k])
+			continue;
+		if (!any || _x[k] < *left)
+			*left = _x[k];
+		if (!any || _x[k] > *right)
+			*right = _x[k];
+		if (!any || _y[k] < *bottom)
+			*bottom = _y[k];
+		if (!any || _y[k] > *top)
+			*top = _y[k];
+		any = true;
+	}
+	if (!any)
+		return false;
+	double margin = COLLISION_DISTANCE / 2;
+	*left -= margin;
+	*right += margin;
+	*bottom -= margin;
+	*top += margin;
+	return true;
+}
+/*
+ *	collide
+ *
+ *	Between each pair of samples both dancers move in straight lines, so their
+ *	separation is a linear function of time and the closest approach can be found
+ *	exactly.  Sets at to the sample where the collision begins.
+ */
+static bool collide(const SweptPath& a, const SweptPath& b, int first, int last, int* at) {
+	for (int k = first; k < last; k++) {
+		if (!a.located(k) || !a.located(k + 1) || !b.located(k) || !b.located(k + 1))
+			continue;
+		double rx = a.x(k) - b.x(k);
+		double ry = a.y(k) - b.y(k);
+		double dx = (a.x(k + 1) - b.x(k + 1)) - rx;
+		double dy = (a.y(k + 1) - b.y(k + 1)) - ry;
+		double s = 0;
+		double d2 = dx * dx + dy * dy;
+		if (d2 > 0) {
+			s = -(rx * dx + ry * dy) / d2;
+			if (s < 0)
+				s = 0;
+			else if (s > 1)
+				s = 1;
+		}
+		double cx = rx + s * dx;
+		double cy = ry + s * dy;
+		if (cx * cx + cy * cy >= COLLISION_DISTANCE * COLLISION_DISTANCE)
+			continue;
+		if (passing(a, b, k, cx, cy))
+			continue;
+		*at = k;
+		return true;
+	}
+	return false;
+}
+
+/*
+ *	passing
+ *
+ *	True if the dancers are both walking forward in opposite directions, and at their
+ *	closest approach (cx, cy) their centers are at least a shoulder's clearance apart
+ *	across their line of travel.  That is how passing right shoulders is drawn.  Two
+ *	dancers walking nose to nose are not passing.
+ */
+static bool passing(const SweptPath& a, const SweptPath& b, int k, double cx, double cy) {
+	if (!walkingForward(a, k) || !walkingForward(b, k))
+		return false;
+	double ax = a.x(k + 1) - a.x(k);
+	double ay = a.y(k + 1) - a.y(k);
+	if (ax * (b.x(k + 1) - b.x(k)) + ay * (b.y(k + 1) - b.y(k)) >= 0)
+		return false;
+	double offset = abs(cx * ay - cy * ax) / sqrt(ax * ax + ay * ay);
+	return offset >= SHOULDER_CLEARANCE;
+}
+
+static bool walkingForward(const SweptPath& path, int k) {
+	double dx = path.x(k + 1) - path.x(k);
+	double dy = path.y(k + 1) - path.y(k);
+	double length = sqrt(dx * dx + dy * dy);
+	if (length < EPSILON)
+		return false;
+	return (dx * cos(path.nose(k)) + dy * sin(path.nose(k))) > length * 0.9;
+}
+
+/*
+ *	turningTogether
+ *
+ *	True if both motions turn about the same center at the same rate.  That is how
+ *	dancers are drawn who hold hands or arms through a turn (swing, arm turns, courtesy
+ *	turn, star promenade), and they keep their distance however close it is.
+ */
+static bool turningTogether(const Motion* a, const Motion* b) {
+	if (a == null || b == null ||
+		typeid(*a) != typeid(Curve) || typeid(*b) != typeid(Curve) ||
+		a->duration() == 0 || b->duration() == 0)
+		return false;
+	const Curve* ca = (const Curve*)a;
+	const Curve* cb = (const Curve*)b;
+	return abs(ca->center().x - cb->center().x) < EPSILON &&
+		   abs(ca->center().y - cb->center().y) < EPSILON &&
+		   abs(ca->motionAngle() / ca->duration() - cb->motionAngle() / cb->duration()) < EPSILON;
+}
+
+static void gatherVariants(const Plan* p, vector<VariantTile>* output) {
+	if (!gatherVariant(p, output))
+		return;
+	for (int i = 0; i < p->stepCount(); i++) {
+		const Step* step = p->step(i);
+		for (int j = 0; j < step->collapsed().size(); j++)
+			gatherVariant(step->collapsed()[j], output);
+		const vector<Tile*>& tiles = step->tiles();
+		for (int j = 0; j < tiles.size(); j++)
+			gatherVariants(tiles[j]->plan(), output);
+	}
+}
+/*
+ *	gatherVariant
+ *
+ *	Notes the variant the plan applied, if any.  Returns true if the plan's own steps
+ *	should be searched as well: only the parts of a 'connective' transparent_ call are.
+ *	Concepts modify their operands so extensively that a call under a concept can't
+ *	be counted as covered.
+ */
+static bool gatherVariant(const Plan* p, vector<VariantTile>* output) {
+	const Variant* v = p->applied();
+	if (v == null)
+		return true;
+	output->push_back(VariantTile(v, p->matched()));
+	return v->definition()->name() == "transparent_";
+}
 
 bool Stage::resolved() const {
 	const Group* d = final();
@@ -358,24 +683,94 @@ Anything* Stage::newAnything(bool inDefinition, const Definition* definition) {
 	return a;
 }
 
-Integer* Stage::newInteger(int value) {
+const Integer* Stage::newInteger(int value) {
+	if (_termPool) {
+		const Integer* pooled = _termPool->integer(value);
+		if (pooled)
+			return pooled;
+	}
 	Integer* i = new Integer(value);
 	_terms.push_back(i);
 	return i;
 }
 
-Anyone* Stage::newAnyone(DancerSet dancerSet, unsigned mask, const Anyone* left, const Anyone* right, Level level) {
+const Anyone* Stage::newAnyone(DancerSet dancerSet, unsigned mask, const Anyone* left, const Anyone* right, Level level) {
+	if (_termPool) {
+		const Anyone* pooled = _termPool->anyone(dancerSet, mask, left, right, level);
+		if (pooled)
+			return pooled;
+	}
 	Anyone* a = new Anyone(dancerSet, mask, left, right, level);
 	_terms.push_back(a);
 	return a;
 }
 
-Fraction* Stage::newFraction(int whole, int num, int denom) {
+const Fraction* Stage::newFraction(int whole, int num, int denom) {
+	if (_termPool) {
+		const Fraction* pooled = _termPool->fraction(whole, num, denom);
+		if (pooled)
+			return pooled;
+	}
 	Fraction* f = new Fraction(whole, num, denom);
 	_terms.push_back(f);
 	return f;
 }
 
+TermPool::TermPool() {
+	for (int i = 0; i < POOLED_INTEGERS; i++) {
+		Integer* n = new Integer(i);
+		_terms.push_back(n);
+		_integers[i] = n;
+	}
+	int f = 0;
+	for (int whole = 0; whole < POOLED_WHOLES; whole++)
+		for (int denom = 1; denom <= POOLED_DENOMINATOR; denom++)
+			for (int num = 0; num < denom; num++) {
+				Fraction* fr = new Fraction(whole, num, denom);
+				_terms.push_back(fr);
+				_fractions[f++] = fr;
+			}
+	for (int i = 0; i < POOLED_DANCERS; i++) {
+		Anyone* a = new Anyone(DANCER_MASK, 1u << i, null, null, NO_LEVEL);
+		_terms.push_back(a);
+		_dancers[i] = a;
+	}
+}
+
+TermPool::~TermPool() {
+	_terms.deleteAll();
+}
+
+const Integer* TermPool::integer(int value) const {
+	if (value < 0 || value >= POOLED_INTEGERS)
+		return null;
+	return _integers[value];
+}
+
+const Fraction* TermPool::fraction(int whole, int num, int denom) const {
+	if (whole < 0 || whole >= POOLED_WHOLES)
+		return null;
+	if (denom < 1 || denom > POOLED_DENOMINATOR)
+		return null;
+	if (num < 0 || num >= denom)
+		return null;
+	// Each whole number holds 1 + 2 + ... + POOLED_DENOMINATOR entries, and within it
+	// the fractions over denom start after those over 1 through denom - 1.
+	return _fractions[whole * (POOLED_FRACTIONS / POOLED_WHOLES) + denom * (denom - 1) / 2 + num];
+}
+
+const Anyone* TermPool::anyone(DancerSet dancerSet, unsigned mask, const Anyone* left, const Anyone* right, Level level) const {
+	if (dancerSet != DANCER_MASK || left != null || right != null || level != NO_LEVEL)
+		return null;
+	// Only a single named dancer is pooled.
+	if (mask == 0 || (mask & (mask - 1)) != 0)
+		return null;
+	for (int i = 0; i < POOLED_DANCERS; i++)
+		if (mask == (1u << i))
+			return _dancers[i];
+	return null;
+}
+
 Straight* Stage::newStraight(Point start, Point end, double startNose, double noseMotion, beats duration) {
 	Straight* s = new Straight(start, end, startNose, noseMotion, duration);
 	_allocedMotions.push_back(s);
@@ -643,6 +1038,82 @@ double Point::distance() const {
 	return sqrt(x * x + y * y);
 }
 
+MotionTimeline::MotionTimeline(Motion* last) {
+	int n = 0;
+	for (Motion* m = last; m; m = m->previous())
+		n++;
+	_startAt.resize(n);
+	_motions.resize(n);
+	for (Motion* m = last; m; m = m->previous()) {
+		n--;
+		_startAt[n] = m->startAt();
+		_motions[n] = m;
+	}
+	_ordered = true;
+	for (int i = 1; i < _startAt.size(); i++)
+		if (_startAt[i] < _startAt[i - 1]) {
+			_ordered = false;
+			break;
+		}
+}
+
+const Motion* MotionTimeline::active(double partial) const {
+	if (!_ordered) {
+		for (int i = _motions.size() - 1; i >= 0; i--)
+			if (_startAt[i] < partial)
+				return _motions[i];
+		return null;
+	}
+	int lo = 0;
+	int hi = _startAt.size();
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (_startAt[mid] < partial)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return null;
+	return _motions[lo - 1];
+}
+
+static const Motion* combineMotion(const Motion* m, double partial, double* x, double* y, double* noseAngle) {
+	for (; m; m = m->previous()) {
+		if (m->startAt() >= partial)
+			continue;
+		double fraction;
+		if (m->endAt() > partial)
+			fraction = (partial - m->startAt()) / m->duration();
+		else
+			fraction = 1;
+		double localX, localY;
+		m->location(fraction, &localX, &localY);
+
+		*noseAngle += m->startNose() + fraction * m->noseMotion();
+		*x += localX;
+		*y += localY;
+		return m;
+	}
+	return null;
+}
+
+bool locateMotion(const Motion* m, double partial, double* x, double* y, double* noseAngle) {
+	*x = 0;
+	*y = 0;
+	*noseAngle = 0;
+
+	bool located = false;
+	while (m) {
+		m = combineMotion(m, partial, x, y, noseAngle);
+		if (m == null)
+			break;
+		located = true;
+		m = m->also();
+	}
+	return located;
+}
+
 void Motion::scheduleAfter(beats startAt) {
 	if (_previous)
 		_previous->scheduleAfter(startAt);
@@ -35,6 +35,11 @@ public:
 const int EXCESSIVE_TURN = 12;		// 12 = 6 quarter turns in a row
 const int OVER_TURN = 8;			// 8 = 4 quarter turns in a row, these should be followed by reverse turns to 'unwind'
 
+const int COLLISION_SAMPLES_PER_BEAT = 8;
+const double COLLISION_DISTANCE = 0.5;	// centers this close means the bodies (1 unit across) are half overlapped
+const double SHOULDER_CLEARANCE = 0.25;	// dancers passing face to face at least this far apart sideways slip past each other's shoulders
+const float PASSING_SIDESTEP = 0.2f;	// how far right of their line dancers passing face to face are drawn at the halfway point
+
 class MotionSet {
 public:
 	MotionSet(bool startTogether);
@@ -149,6 +154,43 @@ private:
 	const Group* _currentDancers;
 };
 
+/*
+ *	MotionTimeline
+ *
+ *	The chain of motions for one dancer in a stage, laid out once in order of
+ *	starting time so that a point in the stage can be found by binary search
+ *	instead of walking back through previous().  The start beats are kept in
+ *	their own array so that the search touches nothing else.
+ */
+class MotionTimeline {
+public:
+	MotionTimeline(Motion* last);
+	/*
+	 *	active
+	 *
+	 *	Returns the last motion that starts before the given beat, null if there is none.
+	 *	This is the motion Picture::combineMotion would have found by walking back from
+	 *	the end of the chain.
+	 */
+	const Motion* active(double partial) const;
+
+	int segments() const { return _motions.size(); }
+
+private:
+	vector<beats>	_startAt;
+	vector<Motion*>	_motions;
+	bool			_ordered;		// false if start times ever decrease along the chain
+};
+
+/*
+ *	locateMotion
+ *
+ *	Computes where a dancer is, and which way the nose points, at the given beat of
+ *	the motion chain ending in m, including any combined 'also' motions.  Returns false
+ *	if no motion in the chain has started by that beat.
+ */
+bool locateMotion(const Motion* m, double partial, double* x, double* y, double* noseAngle);
+
 class Point {
 public:
 	Point(float x, float y) {
@@ -324,6 +366,10 @@ public:
 
 	double radius() const { return _radius; }
 
+	const Point& center() const { return _center; }
+
+	double motionAngle() const { return _motionAngle; }
+
 private:
 	Curve(Point center, double motionAngle, double radius, Point start, Point end, double startNose, double noseMotion, beats duration) 
 		: Motion(start, end, startNose, noseMotion, duration) {
@@ -0,0 +1,102 @@
+#include "../common/platform.h"
+#include "outcomes.h"
+
+#include <typeinfo>
+#include "../common/timing.h"
+#include "call.h"
+
+namespace dance {
+
+CallOutcomes::CallOutcomes(Sequence* sequence, const Grammar* grammar) {
+	_sequence = sequence;
+	_grammar = grammar;
+	_storage = new Stage(sequence, Group::home, grammar->termPool());
+	_size = 0;
+}
+
+CallOutcomes::~CallOutcomes() {
+	dictionary<CallOutcome*>::iterator i = _outcomes.begin();
+	while (i.valid()) {
+		delete *i;
+		i.next();
+	}
+	delete _storage;
+}
+
+bool CallOutcomes::fixed(const Anything* call) {
+	const vector<const Term*>& variables = call->variables();
+	for (int i = 0; i < variables.size(); i++) {
+		const Term* var = variables[i];
+		if (typeid(*var) == typeid(Anything) || typeid(*var) == typeid(Anyone))
+			return false;
+	}
+	return true;
+}
+
+const CallOutcome* CallOutcomes::find(int call, const Group* dancers) {
+	return *_outcomes.get(shapeKey(call, dancers));
+}
+
+Stage* CallOutcomes::apply(const CallOutcome* outcome, const Group* dancers) const {
+	timing::Timer t("CallOutcomes::apply");
+	Context context(_sequence, _grammar);
+	Stage* stage = new Stage(_sequence, dancers, _grammar->termPool());
+	context.startStage(stage);
+	Group* final = outcome->final->cloneNonDancerData(&context);
+	for (int i = 0; i < outcome->from.size(); i++) {
+		const Dancer* spot = outcome->final->dancer(i);
+		const Dancer* d = dancers->dancer(outcome->from[i]);
+		final->insert(new Dancer(spot->x, spot->y, spot->facing, d->gender, d->couple, d->dancerIndex()));
+	}
+	final->done();
+	context.endStage();
+	stage->setFinal(final);
+	return stage;
+}
+
+void CallOutcomes::record(int call, const Group* dancers, const Stage* stage) {
+	if (dancers->base() != null || dancers->realDancerCount() != dancers->dancerCount())
+		return;
+	CallOutcome** entry = _outcomes.get(shapeKey(call, dancers));
+	if (*entry)
+		return;
+	if (stage == null) {
+		*entry = new CallOutcome(null);
+		_size++;
+		return;
+	}
+	const Group* final = stage->final();
+	if (final->base() != null || final->dancerCount() != dancers->dancerCount())
+		return;
+	CallOutcome* outcome = new CallOutcome(null);
+	for (int i = 0; i < final->dancerCount(); i++) {
+		int j;
+		for (j = 0; j < dancers->dancerCount(); j++)
+			if (dancers->dancer(j)->dancerIndex() == final->dancer(i)->dancerIndex())
+				break;
+		if (j == dancers->dancerCount()) {
+			delete outcome;
+			return;
+		}
+		outcome->from.push_back(j);
+	}
+	Context context(_sequence, _grammar);
+	context.startStage(_storage);
+	outcome->final = final->clone(&context);
+	context.endStage();
+	*entry = outcome;
+	_size++;
+}
+
+string CallOutcomes::shapeKey(int call, const Group* dancers) {
+	string key;
+
+	key.printf("%d:%d:%d", call, int(dancers->geometry()), int(dancers->rotation()));
+	for (int i = 0; i < dancers->dancerCount(); i++) {
+		const Dancer* d = dancers->dancer(i);
+		key.printf(";%d,%d,%d,%d,%d", d->x, d->y, int(d->facing), int(d->gender), int(d->couple));
+	}
+	return key;
+}
+
+}  // namespace dance
@@ -0,0 +1,86 @@
+#pragma once
+#include "dance.h"
+
+namespace dance {
+
+class Grammar;
+class Sequence;
+/*
+ *	CallOutcome
+ *
+ *	What one call does from one shape of dancers: the final group it was first
+ *	performed to, and for each dancer in that group, the index in the start group of
+ *	the dancer who ended there.  A null final means the call fails from the shape.
+ */
+class CallOutcome {
+public:
+	CallOutcome(const Group* final) {
+		this->final = final;
+	}
+
+	const Group*	final;
+	vector<int>		from;
+};
+/*
+ *	CallOutcomes
+ *
+ *	A table of what calls do from each shape of dancers they are performed from, so
+ *	that a call can be applied again without running the plan machinery.  The shape
+ *	of a group is its geometry and rotation and the position, facing, gender and
+ *	couple of each dancer.  The couple is needed because calls such as promenade
+ *	home, circle home and swing your partner depend on each dancer's partner, corner
+ *	and home spot.  A group of the same shape, reached by another path through a
+ *	search, ends the same way as the one recorded.
+ *
+ *	Only calls with constant parameters are recorded, since a designator or a concept
+ *	can make the result depend on who the dancers are.  Groups with phantoms, or not
+ *	in the sequence's own coordinates, are not recorded either.
+ */
+class CallOutcomes {
+public:
+	CallOutcomes(Sequence* sequence, const Grammar* grammar);
+
+	~CallOutcomes();
+	/*
+	 *	fixed
+	 *
+	 *	True if none of the call's parameters is a designator or another call, so that
+	 *	what it does depends only on the shape of the dancers (including who they are).
+	 */
+	static bool fixed(const Anything* call);
+	/*
+	 *	find
+	 *
+	 *	Returns the recorded outcome of the call (an index chosen by the caller) from
+	 *	the shape of the dancers, or null if there is none.
+	 */
+	const CallOutcome* find(int call, const Group* dancers);
+	/*
+	 *	apply
+	 *
+	 *	Returns a new stage, which the caller must delete, starting from the dancers and
+	 *	ending in the outcome.  It has no plan and no motions: only its final group is
+	 *	meaningful.
+	 */
+	Stage* apply(const CallOutcome* outcome, const Group* dancers) const;
+	/*
+	 *	record
+	 *
+	 *	Notes the result of performing the call from the dancers: the stage performed,
+	 *	or null if the call failed.
+	 */
+	void record(int call, const Group* dancers, const Stage* stage);
+
+	int size() const { return _size; }
+
+private:
+	static string shapeKey(int call, const Group* dancers);
+
+	Sequence*						_sequence;
+	const Grammar*					_grammar;
+	Stage*							_storage;		// holds the recorded final groups
+	dictionary<CallOutcome*>		_outcomes;		// shape key -> outcome
+	int								_size;
+};
+
+}  // namespace dance
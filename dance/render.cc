@@ -0,0 +1,331 @@
+#include "../common/platform.h"
+#include "render.h"
+
+#include <math.h>
+#include <stdio.h>
+#include "../common/file_system.h"
+#include "call.h"
+#include "dance.h"
+#include "motion.h"
+
+namespace dance {
+
+static const unsigned char* glyph(char c);
+
+static const unsigned BACKGROUND_COLOR = 0xffffff;
+static const unsigned OUTLINE_COLOR = 0x000000;
+static const unsigned NOSE_COLOR = 0x000000;
+static const unsigned BOY_COLOR = 0xa0a0ff;
+static const unsigned GIRL_COLOR = 0xff8080;
+static const unsigned CAPTION_COLOR = 0x000000;
+
+FrameBuffer::FrameBuffer(int width, int height) {
+	_width = width;
+	_height = height;
+	_pixels = new unsigned char[3 * width * height];
+}
+
+FrameBuffer::~FrameBuffer() {
+	delete [] _pixels;
+}
+
+void FrameBuffer::clear(unsigned color) {
+	for (int y = 0; y < _height; y++)
+		for (int x = 0; x < _width; x++)
+			plot(x, y, color);
+}
+
+void FrameBuffer::fillCircle(double x, double y, double radius, unsigned color) {
+	int left = int(floor(x - radius));
+	int right = int(ceil(x + radius));
+	int top = int(floor(y - radius));
+	int bottom = int(ceil(y + radius));
+	for (int j = top; j <= bottom; j++)
+		for (int i = left; i <= right; i++) {
+			double dx = i + 0.5 - x;
+			double dy = j + 0.5 - y;
+			if (dx * dx + dy * dy <= radius * radius)
+				plot(i, j, color);
+		}
+}
+
+void FrameBuffer::fillPolygon(const double* x, const double* y, int count, unsigned color) {
+	if (count < 3)
+		return;
+	double left = x[0], right = x[0], top = y[0], bottom = y[0];
+	for (int k = 1; k < count; k++) {
+		if (x[k] < left)
+			left = x[k];
+		if (x[k] > right)
+			right = x[k];
+		if (y[k] < top)
+			top = y[k];
+		if (y[k] > bottom)
+			bottom = y[k];
+	}
+	for (int j = int(floor(top)); j <= int(ceil(bottom)); j++)
+		for (int i = int(floor(left)); i <= int(ceil(right)); i++) {
+			double px = i + 0.5;
+			double py = j + 0.5;
+			bool anyNegative = false;
+			bool anyPositive = false;
+			for (int k = 0; k < count; k++) {
+				int n = (k + 1) % count;
+				double cross = (x[n] - x[k]) * (py - y[k]) - (y[n] - y[k]) * (px - x[k]);
+				if (cross < 0)
+					anyNegative = true;
+				else if (cross > 0)
+					anyPositive = true;
+			}
+			if (!(anyNegative && anyPositive))
+				plot(i, j, color);
+		}
+}
+
+void FrameBuffer::text(double x, double y, const string& text, int scale, unsigned color) {
+	int advance = 4 * scale;
+	int left = int(x - (text.size() * advance - scale) / 2.0 + 0.5);
+	int top = int(y - 5 * scale / 2.0 + 0.5);
+	for (int c = 0; c < text.size(); c++, left += advance) {
+		const unsigned char* g = glyph(text[c]);
+		if (g == null)
+			continue;
+		for (int row = 0; row < 5; row++)
+			for (int col = 0; col < 3; col++) {
+				if ((g[row] & (4 >> col)) == 0)
+					continue;
+				for (int j = 0; j < scale; j++)
+					for (int i = 0; i < scale; i++)
+						plot(left + col * scale + i, top + row * scale + j, color);
+			}
+	}
+}
+
+bool FrameBuffer::writePPM(const string& filename) const {
+	FILE* fp = fopen(filename.c_str(), "wb");
+	if (fp == null)
+		return false;
+	fprintf(fp, "P6\n%d %d\n255\n", _width, _height);
+	int size = 3 * _width * _height;
+	bool success = int(fwrite(_pixels, 1, size, fp)) == size;
+	if (fclose(fp) != 0)
+		success = false;
+	return success;
+}
+
+void FrameBuffer::plot(int x, int y, unsigned color) {
+	if (x < 0 || x >= _width || y < 0 || y >= _height)
+		return;
+	unsigned char* p = _pixels + 3 * (y * _width + x);
+	p[0] = (color >> 16) & 0xff;
+	p[1] = (color >> 8) & 0xff;
+	p[2] = color & 0xff;
+}
+
+FrameRenderer::FrameRenderer(int halfSpot, int framesPerBeat) {
+	_halfSpot = halfSpot;
+	_framesPerBeat = framesPerBeat;
+}
+
+void FrameRenderer::renderFrame(const Stage* stage, const Group* start, double partial, FrameBuffer* frame) const {
+	frame->clear(BACKGROUND_COLOR);
+	double baseAngle = rotationAngle(start->rotation());
+	if (partial && stage) {
+		bool painted[MAX_DANCERS];
+
+		for (int i = 0; i < MAX_DANCERS; i++)
+			painted[i] = false;
+		int dancerCount = stage->dancerCount();
+		for (int i = 0; i < dancerCount && i < MAX_DANCERS; i++) {
+			double x, y, noseAngle;
+
+			if (locateMotion(stage->activeMotion(i, partial), partial, &x, &y, &noseAngle)) {
+				drawDancer(frame, Gender(i & 1), (i / 2) + 1, x, y, noseAngle, NO_NOSE);
+				painted[i] = true;
+			}
+		}
+		for (int i = 0; i < MAX_DANCERS; i++)
+			if (!painted[i]) {
+				const Dancer* d = start->dancerByIndex(i);
+				if (d)
+					drawDancer(frame, baseAngle, start, d);
+			}
+	} else {
+		for (int i = 0; i < start->dancerCount(); i++)
+			drawDancer(frame, baseAngle, start, start->dancer(i));
+	}
+}
+
+int FrameRenderer::renderSequence(Sequence* sequence, const string& folder, const string& prefix) const {
+	const vector<const Stage*>& stages = sequence->stages();
+	FrameBuffer frame(frameSize(), frameSize());
+
+	if (!fileSystem::ensure(folder))
+		return -1;
+	int frames = 0;
+	for (int s = 0; s <= stages.size(); s++) {
+		const Stage* stage = s < stages.size() ? stages[s] : null;
+		const Group* start = startOf(stages, s);
+		int count = 1;
+		if (stage && !stage->failed() && stage->duration() > 0)
+			count = stage->duration() * _framesPerBeat;
+		for (int f = 0; f < count; f++) {
+			string name;
+
+			renderFrame(stage, start, double(f) / _framesPerBeat, &frame);
+			name.printf("%s_%05d", prefix.c_str(), frames);
+			if (!frame.writePPM(fileSystem::constructPath(folder, name, ".ppm")))
+				return -1;
+			frames++;
+		}
+	}
+	return frames;
+}
+/*
+ *	The same rule Picture::setIndex uses: a stage starts from the final formation of
+ *	the last stage before it that did not fail.
+ */
+const Group* FrameRenderer::startOf(const vector<const Stage*>& stages, int index) {
+	while (index > 0) {
+		if (index <= stages.size()) {
+			const Stage* previous = stages[index - 1];
+			if (previous && !previous->failed())
+				return previous->final();
+		}
+		index--;
+	}
+	return Group::home;
+}
+
+void FrameRenderer::drawDancer(FrameBuffer* frame, double baseAngle, const Group* start, const Dancer* dancer) const {
+	float x = dancer->x;
+	float y = dancer->y;
+	double noseAngle;
+	double secondNoseAngle;
+
+	if (baseAngle == 0 && start->geometry() != RING)
+		facingToAngles(dancer->facing, &noseAngle, &secondNoseAngle);
+	else {
+		Facing facing = dancer->facing;
+		secondNoseAngle = NO_NOSE;
+		start->convertToAbsolute(&x, &y, &facing, &noseAngle);
+	}
+	drawDancer(frame, dancer->gender, dancer->couple, x, y, noseAngle, secondNoseAngle);
+}
+
+void FrameRenderer::drawDancer(FrameBuffer* frame, Gender gender, int couple, double x, double y, double noseAngle, double secondNoseAngle) const {
+	double center = frameSize() / 2.0;
+	double dancerX = center + x * _halfSpot;
+	double dancerY = center - y * _halfSpot;
+	unsigned color;
+	switch (gender) {
+	case	BOY:
+		color = BOY_COLOR;
+		break;
+
+	case	GIRL:
+		color = GIRL_COLOR;
+		break;
+
+	default:
+		color = BACKGROUND_COLOR;
+	}
+	string caption;
+	switch (couple) {
+	case	0:
+		caption = "";
+		break;
+
+	case	7:
+		caption = "H";
+		break;
+
+	case	8:
+		caption = "S";
+		break;
+
+	default:
+		caption = string(couple);
+	}
+	drawNose(frame, dancerX, dancerY, noseAngle);
+	drawNose(frame, dancerX, dancerY, secondNoseAngle);
+	if (gender == BOY) {
+		double outerX[4], outerY[4];
+		double innerX[4], innerY[4];
+		double reach = _halfSpot * sqrt(2.0) / 2;
+		for (int k = 0; k < 4; k++) {
+			double angle = noseAngle + PI / 4 + k * PI / 2;
+			outerX[k] = dancerX + cos(angle) * reach;
+			outerY[k] = dancerY - sin(angle) * reach;
+			innerX[k] = dancerX + cos(angle) * (reach - 1);
+			innerY[k] = dancerY - sin(angle) * (reach - 1);
+		}
+		frame->fillPolygon(outerX, outerY, 4, OUTLINE_COLOR);
+		frame->fillPolygon(innerX, innerY, 4, color);
+	} else {
+		frame->fillCircle(dancerX, dancerY, _halfSpot / 2.0, OUTLINE_COLOR);
+		frame->fillCircle(dancerX, dancerY, _halfSpot / 2.0 - 1, color);
+	}
+	if (caption.size())
+		frame->text(dancerX, dancerY, caption, _halfSpot >= 20 ? 2 : 1, CAPTION_COLOR);
+}
+
+void FrameRenderer::drawNose(FrameBuffer* frame, double x, double y, double noseAngle) const {
+	if (noseAngle == NO_NOSE)
+		return;
+	double noseX = x + cos(noseAngle) * _halfSpot / 2;
+	double noseY = y - sin(noseAngle) * _halfSpot / 2;
+	int noseSize = _halfSpot / 4;
+	if (noseSize < 8)
+		noseSize += 2;
+	frame->fillCircle(noseX, noseY, noseSize / 2.0, NOSE_COLOR);
+}
+
+bool renderDanceFile(const string& filename, const Grammar* grammar, const string& folder) {
+	Dance d(fileSystem::basename(filename), filename);
+	if (!d.read())
+		return false;
+	FrameRenderer renderer(RENDER_HALF_SPOT, RENDER_FRAMES_PER_BEAT);
+	const vector<Sequence*>& sequences = d.sequences();
+	bool success = true;
+	for (int i = 0; i < sequences.size(); i++) {
+		string prefix;
+
+		sequences[i]->run(true, grammar);
+		prefix.printf("%s_%03d", d.label().c_str(), i + 1);
+		int frames = renderer.renderSequence(sequences[i], folder, prefix);
+		if (frames < 0)
+			success = false;
+		else if (verboseOutput)
+			printf("%s: %d frames\n", prefix.c_str(), frames);
+	}
+	return success;
+}
+
+static const unsigned char* glyph(char c) {
+	static const unsigned char digits[10][5] = {
+		{ 7, 5, 5, 5, 7 },
+		{ 2, 6, 2, 2, 7 },
+		{ 7, 1, 7, 4, 7 },
+		{ 7, 1, 7, 1, 7 },
+		{ 5, 5, 7, 1, 1 },
+		{ 7, 4, 7, 1, 7 },
+		{ 7, 4, 7, 5, 7 },
+		{ 7, 1, 1, 1, 1 },
+		{ 7, 5, 7, 5, 7 },
+		{ 7, 5, 7, 1, 7 },
+	};
+	static const unsigned char letterH[5] = { 5, 5, 7, 5, 5 };
+	static const unsigned char letterS[5] = { 3, 4, 2, 1, 6 };
+
+	if (c >= '0' && c <= '9')
+		return digits[c - '0'];
+	else if (c == 'H')
+		return letterH;
+	else if (c == 'S')
+		return letterS;
+	else
+		return null;
+}
+
+}  // namespace dance
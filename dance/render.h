@@ -0,0 +1,106 @@
+#pragma once
+#include "dance.h"
+
+namespace dance {
+
+class Grammar;
+class Sequence;
+class Stage;
+
+const int RENDER_HALF_SPOT = 24;			// pixels per half spot in rendered frames
+const int RENDER_FRAMES_PER_BEAT = 10;
+const int RENDER_FIELD = 16;				// spots across a frame, the same -8 to 8 field Picture uses
+/*
+ *	FrameBuffer
+ *
+ *	An in-memory RGB image.  Colors are given as 0xrrggbb.  Pixels outside the
+ *	buffer are silently clipped.
+ */
+class FrameBuffer {
+public:
+	FrameBuffer(int width, int height);
+
+	~FrameBuffer();
+
+	void clear(unsigned color);
+
+	void fillCircle(double x, double y, double radius, unsigned color);
+	/*
+	 *	fillPolygon
+	 *
+	 *	Fills a convex polygon, with the vertices given in either winding order.
+	 */
+	void fillPolygon(const double* x, const double* y, int count, unsigned color);
+	/*
+	 *	text
+	 *
+	 *	Draws the text centered on x, y using a small built-in font.  Only digits and
+	 *	the letters H and S (the couple captions) have glyphs, anything else is left blank.
+	 */
+	void text(double x, double y, const string& text, int scale, unsigned color);
+
+	bool writePPM(const string& filename) const;
+
+	int width() const { return _width; }
+
+	int height() const { return _height; }
+
+	const unsigned char* pixels() const { return _pixels; }
+
+private:
+	void plot(int x, int y, unsigned color);
+
+	int				_width;
+	int				_height;
+	unsigned char*	_pixels;
+};
+/*
+ *	FrameRenderer
+ *
+ *	Draws a sequence the way the animation Picture does, but into a FrameBuffer
+ *	instead of a display device, so that frames can be produced without a UI.
+ *
+ *	Each frame depends only on the stage and the beat it samples, so any frame can be
+ *	rendered on its own, in any order, with the same result.
+ */
+class FrameRenderer {
+public:
+	FrameRenderer(int halfSpot, int framesPerBeat);
+
+	int frameSize() const { return _halfSpot * RENDER_FIELD; }
+	/*
+	 *	renderFrame
+	 *
+	 *	Draws the dancers partial beats into the stage.  If partial is zero, or there is no
+	 *	stage, the start formation is drawn as it stands.
+	 */
+	void renderFrame(const Stage* stage, const Group* start, double partial, FrameBuffer* frame) const;
+	/*
+	 *	renderSequence
+	 *
+	 *	Writes every frame of the sequence into folder as prefix_nnnnn.ppm.  Returns the
+	 *	number of frames written, or -1 if a file could not be written.
+	 */
+	int renderSequence(Sequence* sequence, const string& folder, const string& prefix) const;
+
+	static const Group* startOf(const vector<const Stage*>& stages, int index);
+
+private:
+	void drawDancer(FrameBuffer* frame, double baseAngle, const Group* start, const Dancer* dancer) const;
+
+	void drawDancer(FrameBuffer* frame, Gender gender, int couple, double x, double y, double noseAngle, double secondNoseAngle) const;
+
+	void drawNose(FrameBuffer* frame, double x, double y, double noseAngle) const;
+
+	int		_halfSpot;
+	int		_framesPerBeat;
+};
+/*
+ *	renderDanceFile
+ *
+ *	Reads a .dnc file, runs each of its sequences against the grammar and renders them
+ *	into folder.  Returns false if the file could not be read or a frame could not be written.
+ */
+bool renderDanceFile(const string& filename, const Grammar* grammar, const string& folder);
+
+}  // namespace dance
@@ -0,0 +1,343 @@
+#include "../common/platform.h"
+#include "resolve.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include "../common/timing.h"
+#include "call.h"
+#include "outcomes.h"
+
+namespace dance {
+
+const int UNPAIRED_SCORE = 4;				// per couple not standing together
+const int OUT_OF_SEQUENCE_SCORE = 8;
+
+class ResolveStep {
+public:
+	ResolveStep(Stage* stage, int call, int score) {
+		this->stage = stage;
+		this->call = call;
+		this->score = score;
+	}
+
+	~ResolveStep() {
+		delete stage;
+	}
+
+	int compare(const ResolveStep* other) const {
+		if (score != other->score)
+			return score - other->score;
+		return call - other->call;
+	}
+
+	Stage*	stage;
+	int		call;				// index in the resolver's candidates
+	int		score;
+};
+
+CandidateCalls::CandidateCalls(const Grammar* grammar, Level level) {
+	timing::Timer t("CandidateCalls::CandidateCalls");
+	_grammar = grammar;
+	_level = level;
+	for (const Grammar* g = grammar; g; g = g->backupGrammar())
+		_versions.push_back(g->version());
+	_sequence = new Sequence(null);
+	_sequence->setLevel(level);
+	_parseStage = new Stage(_sequence, Group::home, grammar->termPool());
+	if (level <= NO_LEVEL)
+		level = INT_MAX;
+	dictionary<int> seen;
+	for (const Grammar* g = grammar; g; g = g->backupGrammar())
+		addCandidates(g, level, &seen);
+}
+
+CandidateCalls::~CandidateCalls() {
+	delete _parseStage;
+	delete _sequence;
+}
+
+bool CandidateCalls::matches(const Grammar* grammar, Level level) const {
+	if (grammar != _grammar || level != _level)
+		return false;
+	int i = 0;
+	for (const Grammar* g = grammar; g; g = g->backupGrammar(), i++)
+		if (i >= _versions.size() || g->version() != _versions[i])
+			return false;
+	return i == _versions.size();
+}
+
+CallSearch::CallSearch(const Grammar* grammar, Level level) : _ownCandidates(new CandidateCalls(grammar, level)), _candidates(_ownCandidates->calls()) {
+	_list = _ownCandidates;
+	init();
+}
+
+CallSearch::CallSearch(const CandidateCalls* candidates) : _ownCandidates(null), _candidates(candidates->calls()) {
+	_list = candidates;
+	init();
+}
+
+CallSearch::~CallSearch() {
+	delete _outcomes;
+	delete _ownCandidates;
+}
+
+void CallSearch::init() {
+	_grammar = _list->grammar();
+	_sequence = _list->sequence();
+	_outcomes = new CallOutcomes(_sequence, _grammar);
+	_deadline = 0;
+	_timedOut = false;
+	_performed = 0;
+}
+
+void CallSearch::startClock(int milliseconds) {
+	_timedOut = false;
+	_performed = 0;
+	_deadline = clock() + clock_t(milliseconds) * CLOCKS_PER_SEC / 1000;
+}
+
+Resolver::Resolver(const Grammar* grammar, Level level) : CallSearch(grammar, level) {
+}
+
+Resolver::Resolver(const CandidateCalls* candidates) : CallSearch(candidates) {
+}
+
+Resolver::~Resolver() {
+	_resolves.deleteAll();
+}
+
+int Resolver::search(const Group* dancers, int maxCalls, int milliseconds) {
+	timing::Timer t("Resolver::search");
+	_resolves.deleteAll();
+	_explored.clear();
+	_path.clear();
+	startClock(milliseconds);
+	if (dancers->atHome())
+		return 0;
+	for (int depth = 1; depth <= maxCalls && _resolves.size() == 0 && !expired(); depth++)
+		expand(dancers, depth);
+	return _resolves.size();
+}
+/*
+ *	Level 2 ('None' in levels.txt) holds notation, such as 'face in', rather than
+ *	calls, so it is left out.  Each candidate is parsed once, into _parseStage, and
+ *	the parsed call is performed from every position, as Sequence::expandStage does
+ *	with a pruned stage's call.  A candidate that does not parse, or uses an off-level
+ *	designator, is dropped.
+ */
+void CandidateCalls::addCandidates(const Grammar* grammar, Level level, dictionary<int>* seen) {
+	Context context(_sequence, _grammar);
+	context.startStage(_parseStage);
+	const vector<Definition*>& definitions = grammar->definitions();
+	for (int i = 0; i < definitions.size(); i++) {
+		const Definition* d = definitions[i];
+		if (d->level() <= NO_LEVEL + 1 || d->level() > level)
+			continue;
+		const vector<string>& productions = d->productions();
+		for (int j = 0; j < productions.size(); j++) {
+			vector<string> texts;
+			texts.push_back(string());
+			const char* s = productions[j].c_str();
+			while (*s && texts.size()) {
+				while (*s == ' ')
+					s++;
+				const char* w = s;
+				bool plain = true;
+				while (*s && *s != ' ') {
+					if (isupper(*s) || *s == '_')
+						plain = false;
+					s++;
+				}
+				if (s == w)
+					break;
+				string word(w);
+				word = word.substr(0, int(s - w));
+				vector<string> choices;
+				if (plain)
+					choices.push_back(word);
+				else if (word == "R_L") {
+					choices.push_back("right");
+					choices.push_back("left");
+				} else if (word == "ANYONE") {
+					choices.push_back("heads");
+					choices.push_back("sides");
+				}
+				vector<string> extended;
+				for (int k = 0; k < texts.size(); k++)
+					for (int m = 0; m < choices.size(); m++)
+						extended.push_back(texts[k].size() ? texts[k] + " " + choices[m] : choices[m]);
+				texts.clear();
+				for (int k = 0; k < extended.size(); k++)
+					texts.push_back(extended[k]);
+			}
+			for (int k = 0; k < texts.size(); k++) {
+				int* found = seen->get(texts[k]);
+				if (*found)
+					continue;
+				*found = 1;
+				const Anything* c = _grammar->parse(null, texts[k], false, null, &context, null);
+				if (c == null || !onLevel(c))
+					continue;
+				_calls.push_back(texts[k]);
+				_parsed.push_back(c);
+				_fixed.push_back(tabulateOutcomes && CallOutcomes::fixed(c));
+			}
+		}
+	}
+	context.endStage();
+}
+
+void Resolver::expand(const Group* dancers, int remaining) {
+	if (expired())
+		return;
+	int* explored = _explored.get(positionKey(dancers));
+	if (*explored > remaining)
+		return;
+	*explored = remaining + 1;
+	vector<ResolveStep*> steps;
+	for (int i = 0; i < _candidates.size() && !expired(); i++) {
+		Stage* stage = perform(dancers, i);
+		if (stage == null)
+			continue;
+		const Group* final = stage->final();
+
+		// Any shorter resolve would have been found by an earlier pass, so home can
+		// only be reached here with the last call.
+
+		if (final->atHome()) {
+			if (remaining == 1 && _resolves.size() < RESOLVE_MAX_RESULTS) {
+				CallList* r = new CallList;
+				for (int j = 0; j < _path.size(); j++)
+					r->calls.push_back(_path[j]);
+				r->calls.push_back(_candidates[i]);
+				_resolves.push_back(r);
+			}
+			delete stage;
+		} else if (remaining == 1 || final->equals(dancers))
+			delete stage;
+		else
+			steps.push_back(new ResolveStep(stage, i, score(final)));
+	}
+	steps.sort();
+	for (int i = 0; i < steps.size() && _resolves.size() < RESOLVE_MAX_RESULTS && !expired(); i++) {
+		_path.push_back(_candidates[steps[i]->call]);
+		expand(steps[i]->stage->final(), remaining - 1);
+		_path.resize(_path.size() - 1);
+	}
+	steps.deleteAll();
+}
+
+Stage* CallSearch::perform(const Group* dancers, const string& call) {
+	Context context(_sequence, _grammar);
+	Stage* stage = new Stage(_sequence, dancers, _grammar->termPool());
+	context.startStage(stage);
+	const Anything* c = _grammar->parse(null, call, false, null, &context, null);
+	if (c == null || !_list->onLevel(c)) {
+		delete stage;
+		return null;
+	}
+	return perform(stage, c, &context);
+}
+
+Stage* CallSearch::perform(const Group* dancers, int candidate) {
+	if (_list->fixed(candidate)) {
+		const CallOutcome* outcome = _outcomes->find(candidate, dancers);
+		if (outcome) {
+			if (outcome->final == null)
+				return null;
+			return _outcomes->apply(outcome, dancers);
+		}
+	}
+	Context context(_sequence, _grammar);
+	Stage* stage = new Stage(_sequence, dancers, _grammar->termPool());
+	context.startStage(stage);
+	stage = perform(stage, _list->parsed(candidate), &context);
+	if (_list->fixed(candidate))
+		_outcomes->record(candidate, dancers, stage);
+	return stage;
+}
+
+Stage* CallSearch::perform(Stage* stage, const Anything* call, Context* context) {
+	_performed++;
+	stage->setCall(call);
+	stage->perform(null, context, TILE_ALL);
+	stage->breathe(context);
+	context->endStage();
+	if (stage->failed() || stage->final() == null) {
+		delete stage;
+		return null;
+	}
+	return stage;
+}
+
+bool CandidateCalls::onLevel(const Anything* call) const {
+	return _sequence->level() <= NO_LEVEL || call->designatorLevel() <= _sequence->level();
+}
+
+bool CallSearch::expired() {
+	if (!_timedOut && clock() >= _deadline)
+		_timedOut = true;
+	return _timedOut;
+}
+
+string CallSearch::positionKey(const Group* dancers) {
+	string key;
+
+	key.printf("%I64x:%d:%d", dancers->hash(), int(dancers->geometry()), int(dancers->rotation()));
+	return key;
+}
+/*
+ *	score
+ *
+ *	How far the dancers are from a resolve, used to choose which calls to explore
+ *	first: each dancer's distance and facing from home, plus a penalty for each couple
+ *	not standing together and one if the couples are out of sequence around the set.
+ */
+int Resolver::score(const Group* dancers) {
+	int total = 0;
+	for (int i = 0; i < Group::home->dancerCount(); i++) {
+		const Dancer* h = Group::home->dancer(i);
+		const Dancer* d = dancers->dancerByIndex(h->dancerIndex());
+		if (d == null)
+			return INT_MAX / 2;
+		total += abs(d->x - h->x) + abs(d->y - h->y);
+		if (d->facing != h->facing)
+			total++;
+	}
+	double angle[5];
+	for (int c = 1; c <= 4; c++) {
+		const Dancer* boy = dancers->dancerByIndex(BOY + 2 * (c - 1));
+		const Dancer* girl = dancers->dancerByIndex(GIRL + 2 * (c - 1));
+		if (abs(boy->x - girl->x) + abs(boy->y - girl->y) > 2)
+			total += UNPAIRED_SCORE;
+		angle[c] = atan2(double(boy->y + girl->y), double(boy->x + girl->x));
+	}
+
+	// At home the couples are numbered counter-clockwise, so going counter-clockwise
+	// from each couple the next one met should be the next couple number.
+
+	for (int c = 1; c <= 4; c++) {
+		int next = 0;
+		double nearest = 0;
+		for (int o = 1; o <= 4; o++) {
+			if (o == c)
+				continue;
+			double delta = angle[o] - angle[c];
+			while (delta <= 0)
+				delta += 2 * PI;
+			if (next == 0 || delta < nearest) {
+				next = o;
+				nearest = delta;
+			}
+		}
+		if (next != c % 4 + 1) {
+			total += OUT_OF_SEQUENCE_SCORE;
+			break;
+		}
+	}
+	return total;
+}
+
+}  // namespace dance
@@ -0,0 +1,177 @@
+#pragma once
+#include "dance.h"
+
+namespace dance {
+
+class CallOutcomes;
+class Grammar;
+class Group;
+class Sequence;
+class Stage;
+
+const int RESOLVE_MAX_CALLS = 4;
+const int RESOLVE_MAX_RESULTS = 8;
+const int RESOLVE_MILLISECONDS = 1500;		// long enough to be worth waiting for in the SequenceEditor
+
+class CallList {
+public:
+	vector<string>	calls;
+};
+/*
+ *	CandidateCalls
+ *
+ *	The calls a search tries from each position, parsed once.  Candidates are the
+ *	productions, at or below a level, with no parameters other than a direction or a
+ *	heads/sides designator.  Parsing them all takes far longer than a short search, so
+ *	an editor keeps one list and hands it to each search for as long as it matches
+ *	the grammar's version and the level.
+ */
+class CandidateCalls {
+public:
+	CandidateCalls(const Grammar* grammar, Level level);
+
+	~CandidateCalls();
+	/*
+	 *	matches
+	 *
+	 *	True if the list was built from this grammar, unchanged since, and this level.
+	 */
+	bool matches(const Grammar* grammar, Level level) const;
+
+	const Grammar* grammar() const { return _grammar; }
+
+	Level level() const { return _level; }
+
+	Sequence* sequence() const { return _sequence; }
+
+	const vector<string>& calls() const { return _calls; }
+
+	const Anything* parsed(int i) const { return _parsed[i]; }
+
+	bool fixed(int i) const { return _fixed[i]; }
+	/*
+	 *	onLevel
+	 *
+	 *	False if the call uses a designator above the list's level.
+	 */
+	bool onLevel(const Anything* call) const;
+
+private:
+	void addCandidates(const Grammar* grammar, Level level, dictionary<int>* seen);
+
+	const Grammar*			_grammar;
+	vector<int>				_versions;			// of the grammar and each backup grammar
+	Level					_level;
+	Sequence*				_sequence;			// supplies the level to each Context
+	Stage*					_parseStage;		// holds the parsed candidates
+	vector<string>			_calls;
+	vector<const Anything*>	_parsed;			// parallel to _calls
+	vector<bool>			_fixed;				// parallel to _calls, true if the outcome can be tabled
+};
+/*
+ *	CallSearch
+ *
+ *	What the searches over call sequences share.  Candidate calls come from a
+ *	CandidateCalls list, either one given or one built for the search, and each is
+ *	performed as a Stage of its own, exactly as in a sequence.
+ *
+ *	Under tabulateOutcomes, a candidate whose result depends only on the shape of
+ *	the dancers is performed once per shape and then applied from the CallOutcomes
+ *	table.
+ */
+class CallSearch {
+public:
+	CallSearch(const Grammar* grammar, Level level);
+
+	CallSearch(const CandidateCalls* candidates);
+
+	virtual ~CallSearch();
+
+	const vector<string>& candidates() const { return _candidates; }
+
+	bool timedOut() const { return _timedOut; }
+
+	int performed() const { return _performed; }
+
+	const CallOutcomes* outcomes() const { return _outcomes; }
+
+protected:
+	void startClock(int milliseconds);
+	/*
+	 *	perform
+	 *
+	 *	Returns the stage for the call performed from the dancers, which the caller
+	 *	must delete, or null if the call does not parse or fails.
+	 */
+	Stage* perform(const Group* dancers, const string& call);
+
+	Stage* perform(const Group* dancers, int candidate);
+
+	bool expired();
+	/*
+	 *	positionKey
+	 *
+	 *	Identifies the dancers' positions and facings: the Zobrist hash, with the
+	 *	geometry and rotation that Group::equals also compares.
+	 */
+	static string positionKey(const Group* dancers);
+
+	CandidateCalls*			_ownCandidates;		// built for the search if none was given; declared before _candidates, which refers to it
+	const CandidateCalls*	_list;
+	const Grammar*			_grammar;
+	Sequence*				_sequence;			// supplies the level to each Context
+	const vector<string>&	_candidates;		// the list's calls
+
+private:
+	void init();
+
+	Stage* perform(Stage* stage, const Anything* call, Context* context);
+
+	CallOutcomes*			_outcomes;
+
+	clock_t				_deadline;
+	bool				_timedOut;
+	int					_performed;
+};
+/*
+ *	Resolver
+ *
+ *	Searches for short call sequences that take the dancers from a given position
+ *	back to home.
+ *
+ *	The search is iterative deepening: every sequence of one call is tried, then of
+ *	two, and so on, so the first resolves found are the shortest.  At each depth the
+ *	calls that leave the dancers closest to a resolve (partners paired, couples in
+ *	sequence, near home) are explored first.  A transposition table keyed by the
+ *	dancers' Zobrist hash skips any position already explored with at least as many
+ *	calls to spare.
+ */
+class Resolver : public CallSearch {
+public:
+	Resolver(const Grammar* grammar, Level level);
+
+	Resolver(const CandidateCalls* candidates);
+
+	~Resolver();
+	/*
+	 *	search
+	 *
+	 *	Looks for resolves of up to maxCalls calls from the dancers, giving up after
+	 *	the given number of milliseconds.  Returns the number found, all of the same
+	 *	(shortest) length.
+	 */
+	int search(const Group* dancers, int maxCalls, int milliseconds);
+
+	const vector<CallList*>& resolves() const { return _resolves; }
+
+private:
+	void expand(const Group* dancers, int remaining);
+
+	static int score(const Group* dancers);
+
+	vector<CallList*>	_resolves;
+	vector<string>		_path;
+	dictionary<int>		_explored;				// position key -> calls remaining + 1 when explored
+};
+
+}  // namespace dance
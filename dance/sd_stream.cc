@@ -0,0 +1,261 @@
+#include "../common/platform.h"
+#include "sd_stream.h"
+
+#include <ctype.h>
+#include <string.h>
+#include "../common/file_system.h"
+#include "../common/timing.h"
+#include "call.h"
+
+namespace dance {
+
+static Level headerLevel(char* header);
+static bool isPicture(const char* text);
+static double percent(int part, int whole);
+
+SdReader::SdReader(const string& filename, Dance* dance) {
+	_filename = filename;
+	_dance = dance;
+	_fp = null;
+	_capacity = SD_READ_BUFFER;
+	_buffer = new char[_capacity + 1];
+	_filled = 0;
+	_position = 0;
+	_atEnd = false;
+	_failed = false;
+	_line = 0;
+	_level = NO_LEVEL;
+	_inCall = false;
+}
+
+SdReader::~SdReader() {
+	if (_fp)
+		fclose(_fp);
+	delete [] _buffer;
+}
+
+bool SdReader::open() {
+	_fp = fileSystem::openTextFile(_filename);
+	return _fp != null;
+}
+
+bool SdReader::open(FILE* fp) {
+	_fp = fp;
+	return _fp != null;
+}
+
+Sequence* SdReader::next() {
+	if (_fp == null)
+		return null;
+	Sequence* sequence = null;
+	char* text;
+	while (readLine(&text)) {
+		bool formFeed = false;
+		while (*text == '\f') {
+			formFeed = true;
+			text++;
+		}
+		char* p = text;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		bool header = p[0] == 'S' && p[1] == 'd' && (isdigit(p[2]) || p[2] == ' ');
+		if (formFeed || header) {
+			finishCall(sequence);
+			if (header)
+				_level = headerLevel(p);
+			if (sequence)
+				return sequence;
+			continue;
+		}
+		if (isdigit(*p)) {
+			char* s = p;
+			while (isdigit(*s))
+				s++;
+			if (*s == ':') {
+				finishCall(sequence);
+				if (sequence == null) {
+					sequence = new Sequence(_dance);
+					sequence->setLevel(_level);
+				}
+				_call = s + 1;
+				_inCall = true;
+				continue;
+			}
+		}
+
+		// sd indents the rest of a call that did not fit on one line.  Anything else
+		// between calls (pictures, warnings, comments) ends the call.
+
+		if (_inCall && p > text && *p != 0 && *p != '(' && strncmp(p, "Warning", 7) != 0 && !isPicture(p)) {
+			_call = _call + " " + p;
+			continue;
+		}
+		finishCall(sequence);
+	}
+	finishCall(sequence);
+	return sequence;
+}
+
+void SdReader::finishCall(Sequence* sequence) {
+	if (!_inCall)
+		return;
+	_inCall = false;
+	sequence->append(_call.trim());
+}
+/*
+ *	Lines are scanned where they lie in the buffer, as in Dance::readFile.  The
+ *	buffer only grows for a line longer than it is.
+ */
+bool SdReader::readLine(char** text) {
+	for (;;) {
+		char* record = _buffer + _position;
+		char* end = _buffer + _filled;
+		char* eol = (char*)memchr(record, '\n', end - record);
+		if (eol == null && _atEnd) {
+			if (record == end)
+				return false;
+			eol = end;
+		}
+		if (eol) {
+			_position = eol < end ? int(eol + 1 - _buffer) : _filled;
+			*eol = 0;
+			if (eol > record && eol[-1] == '\r')
+				eol[-1] = 0;
+			_line++;
+			*text = record;
+			return true;
+		}
+		_filled = int(end - record);
+		memmove(_buffer, record, _filled);
+		_position = 0;
+		if (_filled == _capacity) {
+			char* larger = new char[2 * _capacity + 1];
+			memcpy(larger, _buffer, _filled);
+			delete [] _buffer;
+			_buffer = larger;
+			_capacity *= 2;
+		}
+		_filled += int(fread(_buffer + _filled, 1, _capacity - _filled, _fp));
+		if (ferror(_fp)) {
+			printf("%s line %d: read error\n", _filename.c_str(), _line);
+			_failed = true;
+			_atEnd = true;
+		} else if (feof(_fp))
+			_atEnd = true;
+	}
+}
+
+SdCheck::SdCheck(const Grammar* grammar, bool allowUnresolved) {
+	_grammar = grammar;
+	_allowUnresolved = allowUnresolved;
+	sequences = 0;
+	resolvedSequences = 0;
+	failedSequences = 0;
+	calls = 0;
+	failedCalls = 0;
+}
+
+bool SdCheck::check(const string& filename, FILE* out) {
+	timing::Timer t("SdCheck::check");
+	SdReader reader(filename);
+	if (!reader.open())
+		return false;
+	int index = 0;
+	for (;;) {
+		Sequence* sequence = reader.next();
+		if (sequence == null)
+			break;
+		index++;
+		sequences++;
+		if (!sequence->run(_allowUnresolved, _grammar))
+			failedSequences++;
+		const vector<const Stage*>& stages = sequence->stages();
+		calls += stages.size();
+		for (int i = 0; i < stages.size(); i++) {
+			const Stage* stage = stages[i];
+
+			if (stage->failed()) {
+				failedCalls++;
+				if (out)
+					fprintf(out, " [%d:%d] %s\n", index, i, stage->cause()->text().c_str());
+			}
+		}
+		if (sequence->resolved())
+			resolvedSequences++;
+		checked(sequence, index);
+		delete sequence;
+	}
+	return !reader.failed();
+}
+
+void SdCheck::writeTotals(FILE* out, const string& label) const {
+	fprintf(out, "%s\n   Total sequences %d (resolved %d %0.1f%%) / calls %d (passed %d %0.1f%%)\n", label.c_str(),
+			sequences, resolvedSequences, percent(resolvedSequences, sequences), calls, calls - failedCalls,
+			percent(calls - failedCalls, calls));
+}
+
+Dance* readSdDance(const string& filename) {
+	timing::Timer t("readSdDance");
+	string danceName = fileSystem::constructPath("", filename, ".dnc");
+	Dance* d = new Dance(fileSystem::basename(danceName), danceName);
+	SdReader reader(filename, d);
+	if (!reader.open()) {
+		delete d;
+		return null;
+	}
+	for (;;) {
+		Sequence* sequence = reader.next();
+		if (sequence == null)
+			break;
+		d->append(sequence);
+		d->touch(sequence);
+	}
+	if (reader.failed()) {
+		delete d;
+		return null;
+	}
+	return d;
+}
+/*
+ *	The level is the last word of an sd header line.  sd abbreviates the advanced and
+ *	challenge levels (A1, C3A), which are spelled out in levels.txt.
+ */
+static Level headerLevel(char* header) {
+	char* end = header + strlen(header);
+	while (end > header && isspace(end[-1]))
+		end--;
+	*end = 0;
+	const char* word = end;
+	while (word > header && !isspace(word[-1]))
+		word--;
+	string name;
+	if ((word[0] == 'A' || word[0] == 'C') && isdigit(word[1]))
+		name = string(word[0] == 'A' ? "Advanced-" : "Challenge-") + (word + 1);
+	else
+		name = word;
+	int level = *levelValues.get(name);
+	if (level == 0)
+		return NO_LEVEL;
+	return level;
+}
+/*
+ *	A picture line shows dancers as number, gender and facing: 1B> 3GV
+ */
+static bool isPicture(const char* text) {
+	for (; text[0] && text[1] && text[2]; text++)
+		if (text[0] >= '1' && text[0] <= '4' &&
+			(text[1] == 'B' || text[1] == 'G') &&
+			strchr("<>^V", text[2]) != null)
+			return true;
+	return false;
+}
+/*
+ *	An empty transcript has no sequences or calls, so its totals are 0%.
+ */
+static double percent(int part, int whole) {
+	if (whole == 0)
+		return 0;
+	return (100.0 * part) / whole;
+}
+
+}  // namespace dance
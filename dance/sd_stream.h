@@ -0,0 +1,119 @@
+#pragma once
+#include <stdio.h>
+#include "dance.h"
+
+namespace dance {
+
+class Dance;
+class Grammar;
+class Sequence;
+
+const int SD_READ_BUFFER = 16 * 1024;
+/*
+ *	SdReader
+ *
+ *	Reads the sequences of an sd transcript one at a time.  Only the read buffer and
+ *	the sequence being built are held, so a transcript of any length can be read.
+ *
+ *	A sequence starts at an sd header line (one beginning with "Sd") or a form feed,
+ *	and its calls are the numbered lines ("  3: swing thru").  A call that sd wrapped
+ *	onto indented lines is joined back together.  Pictures, warnings and the resolve
+ *	text are skipped.
+ *
+ *	The sequences are created for dance, which may be null.
+ */
+class SdReader {
+public:
+	SdReader(const string& filename, Dance* dance = null);
+
+	~SdReader();
+
+	bool open();
+	/*
+	 *	open
+	 *
+	 *	Reads from a stream that is already open, such as a temporary file.  The
+	 *	reader closes it.
+	 */
+	bool open(FILE* fp);
+	/*
+	 *	next
+	 *
+	 *	Returns the next sequence, which the caller must delete or append to the
+	 *	reader's Dance, or null at the end of the file.
+	 */
+	Sequence* next();
+
+	const string& filename() const { return _filename; }
+
+	bool failed() const { return _failed; }
+
+private:
+	bool readLine(char** text);
+
+	void finishCall(Sequence* sequence);
+
+	string		_filename;
+	Dance*		_dance;
+	FILE*		_fp;
+	char*		_buffer;
+	int			_capacity;
+	int			_filled;
+	int			_position;		// start of the next line in _buffer
+	bool		_atEnd;
+	bool		_failed;
+	int			_line;
+	Level		_level;			// from the last sd header line
+	string		_call;			// the call being joined from wrapped lines
+	bool		_inCall;
+};
+/*
+ *	SdCheck
+ *
+ *	Performs the sequences of sd transcripts as they are read, reporting the failures
+ *	of each and keeping only running totals.  A sequence, with all its stages, is
+ *	deleted as soon as it has been checked, so memory does not grow with the size of
+ *	the transcript.
+ */
+class SdCheck {
+public:
+	SdCheck(const Grammar* grammar, bool allowUnresolved);
+
+	virtual ~SdCheck() {}
+	/*
+	 *	check
+	 *
+	 *	Checks every sequence of the file, writing a line to out (if not null) for each
+	 *	failed call.  Returns false if the file could not be read.
+	 */
+	bool check(const string& filename, FILE* out);
+
+	void writeTotals(FILE* out, const string& label) const;
+	/*
+	 *	checked
+	 *
+	 *	Called with each sequence after it has been performed and before its stages are
+	 *	deleted.  index counts from 1 within the file.
+	 */
+	virtual void checked(Sequence* sequence, int index) {}
+
+	int		sequences;
+	int		resolvedSequences;
+	int		failedSequences;			// sequences that failed, or are unresolved unless allowed
+	int		calls;
+	int		failedCalls;
+
+private:
+	const Grammar*	_grammar;
+	bool			_allowUnresolved;
+};
+/*
+ *	readSdDance
+ *
+ *	Reads every sequence of an sd transcript into a new Dance, named for the
+ *	transcript with a .dnc extension, for editing.  Returns null if the file
+ *	could not be read.
+ */
+Dance* readSdDance(const string& filename);
+
+}  // namespace dance
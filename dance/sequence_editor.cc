@@ -9,12 +9,16 @@
 #include "../display/scrollbar.h"
 #include "../display/window.h"
 #include "call.h"
+#include "modules.h"
 #include "motion.h"
+#include "resolve.h"
 
 namespace dance {
 
 static display::Color homeColor(0xc0c0c0);
 
+static void showCallLists(const vector<CallList*>& lists, const char* title);
+
 class SequenceChangeCommand : public display::Undo {
 public:
 	SequenceChangeCommand(DanceEditor* editor, Sequence* sequence) {
@@ -318,7 +322,7 @@ void SequenceEditor::updateCallData(int index) {
 		return;
 	}
 	const Stage* stage = _sequence->stages()[index];
-	if (stage->stepCount() > 0) {
+	if (stage->stepCount() > 0 || stage->pruned()) {
 		if (cme->drillDown->canvas() == null) {
 			display::Bevel* b = new display::Bevel(2, new display::Label("?"));
 			b->setBackground(&display::buttonFaceBackground);
@@ -626,6 +630,9 @@ void SequenceEditor::onOpenContextMenu(display::point p, display::Canvas* target
 		display::ContextMenu* c = new display::ContextMenu(_root, p, target);
 		c->choice("Insert a call")->click.addHandler(this, &SequenceEditor::insertCall, index);
 		c->choice("Delete this call")->click.addHandler(this, &SequenceEditor::deleteCall, index);
+		c->choice("Find a resolve from here")->click.addHandler(this, &SequenceEditor::findResolve, index);
+		c->choice("Find zeros from here")->click.addHandler(this, &SequenceEditor::findZeros, index);
+		c->choice("Find equivalents of this call")->click.addHandler(this, &SequenceEditor::findEquivalents, index);
 		c->show();
 	}
 }
@@ -678,4 +685,70 @@ void SequenceEditor::deleteCall(display::point p, display::Canvas* target, int i
 	_parent->undoStack().addUndo(new DeleteCallCommand(_parent, _sequence, i));
 }
 
+void SequenceEditor::findResolve(display::point p, display::Canvas* target, int i) {
+	const vector<const Stage*>& stages = _sequence->stages();
+	if (i >= stages.size() || stages[i]->failed() || stages[i]->final() == null) {
+		warningMessage("The calls up to here must work before a resolve can be found");
+		return;
+	}
+	if (stages[i]->final()->atHome()) {
+		warningMessage("The dancers are already home");
+		return;
+	}
+	Resolver resolver(_frame->candidateCalls(myDefinitions, _sequence->level()));
+	if (resolver.search(stages[i]->final(), RESOLVE_MAX_CALLS, RESOLVE_MILLISECONDS) == 0) {
+		warningMessage(resolver.timedOut() ? "No resolve found in the time allowed" : "No resolve found");
+		return;
+	}
+	showCallLists(resolver.resolves(), "Resolves");
+}
+
+void SequenceEditor::findZeros(display::point p, display::Canvas* target, int i) {
+	const vector<const Stage*>& stages = _sequence->stages();
+	if (i >= stages.size() || stages[i]->failed() || stages[i]->final() == null) {
+		warningMessage("The calls up to here must work before zeros can be found");
+		return;
+	}
+	ModuleFinder finder(_frame->candidateCalls(myDefinitions, _sequence->level()));
+	if (finder.findZeros(stages[i]->final(), MODULE_MAX_CALLS, MODULE_MILLISECONDS) == 0) {
+		warningMessage(finder.timedOut() ? "No zeros found in the time allowed" : "No zeros found");
+		return;
+	}
+	showCallLists(finder.modules(), "Zeros");
+}
+
+void SequenceEditor::findEquivalents(display::point p, display::Canvas* target, int i) {
+	const vector<const Stage*>& stages = _sequence->stages();
+	const Group* start = Group::home;
+	if (i > 0) {
+		if (i > stages.size() || stages[i - 1]->failed() || stages[i - 1]->final() == null) {
+			warningMessage("The calls before this one must work before equivalents can be found");
+			return;
+		}
+		start = stages[i - 1]->final();
+	}
+	vector<string> calls;
+	calls.push_back(_sequence->text()[i]);
+	ModuleFinder finder(_frame->candidateCalls(myDefinitions, _sequence->level()));
+	int found = finder.findEquivalents(start, calls, MODULE_MAX_CALLS, MODULE_MILLISECONDS);
+	if (found < 0) {
+		warningMessage("This call must work before equivalents can be found");
+		return;
+	} else if (found == 0) {
+		warningMessage(finder.timedOut() ? "No equivalents found in the time allowed" : "No equivalents found");
+		return;
+	}
+	showCallLists(finder.modules(), "Equivalents");
+}
+
+static void showCallLists(const vector<CallList*>& lists, const char* title) {
+	string text;
+	for (int i = 0; i < lists.size(); i++) {
+		for (int j = 0; j < lists[i]->calls.size(); j++)
+			text = text + lists[i]->calls[j] + "\n";
+		text = text + "\n";
+	}
+	display::messageBox(null, text, title, MB_OK);
+}
+
 }  // namespace dance
@@ -0,0 +1,312 @@
+#include "../common/platform.h"
+#include "stage_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "../common/timing.h"
+#include "call.h"
+#include "coverage.h"
+
+namespace dance {
+
+static unsigned __int64 hashBytes(unsigned __int64 hash, const void* data, int length);
+static unsigned __int64 hashString(unsigned __int64 hash, const string& s);
+static unsigned __int64 hashDefinition(const Definition* d);
+
+static const unsigned __int64 HASH_BASIS = 0xcbf29ce484222325;
+static const unsigned __int64 HASH_PRIME = 0x100000001b3;
+static const char stageCacheMagic[4] = { 'S', 'i', 'M', 's' };
+
+StageCache::StageCache(const string& filename) {
+	_filename = filename;
+	_modified = false;
+	_grammar = null;
+	_grammarHash = 0;
+}
+
+StageCache::~StageCache() {
+	dictionary<SequenceRecord*>::iterator i = _records.begin();
+	while (i.valid()) {
+		delete *i;
+		i.next();
+	}
+}
+
+bool StageCache::read() {
+	timing::Timer t("StageCache::read");
+	FILE* fp = fopen(_filename.c_str(), "rb");
+	if (fp == null)
+		return false;
+	char magic[sizeof stageCacheMagic];
+	int version;
+	int count;
+	bool result = fread(magic, 1, sizeof magic, fp) == sizeof magic &&
+				  memcmp(magic, stageCacheMagic, sizeof magic) == 0 &&
+				  fread(&version, sizeof version, 1, fp) == 1 &&
+				  version == STAGE_CACHE_VERSION &&
+				  fread(&count, sizeof count, 1, fp) == 1;
+	for (int i = 0; result && i < count; i++) {
+		SequenceRecord* r = new SequenceRecord;
+		int definitions;
+		int variants;
+		int stages;
+
+		result = fread(&r->created, sizeof r->created, 1, fp) == 1 &&
+				 fread(&r->textHash, sizeof r->textHash, 1, fp) == 1 &&
+				 fread(&r->grammarHash, sizeof r->grammarHash, 1, fp) == 1 &&
+				 fread(&r->dependencyHash, sizeof r->dependencyHash, 1, fp) == 1 &&
+				 fread(&r->status, sizeof r->status, 1, fp) == 1 &&
+				 fread(&definitions, sizeof definitions, 1, fp) == 1;
+		for (int j = 0; result && j < definitions; j++) {
+			string label;
+
+			result = readBinaryString(fp, &label);
+			r->definitions.push_back(label);
+		}
+		if (result)
+			result = fread(&variants, sizeof variants, 1, fp) == 1;
+		for (int j = 0; result && j < variants; j++) {
+			string key;
+
+			result = readBinaryString(fp, &key);
+			r->variants.push_back(key);
+		}
+		if (result)
+			result = fread(&stages, sizeof stages, 1, fp) == 1 && stages >= 0;
+		if (result) {
+			r->stages.resize(stages);
+			for (int j = 0; result && j < stages; j++) {
+				StageRecord& sr = r->stages[j];
+				char failed;
+
+				result = fread(&sr.duration, sizeof sr.duration, 1, fp) == 1 &&
+						 fread(&failed, sizeof failed, 1, fp) == 1;
+				sr.failed = failed != 0;
+			}
+		}
+		if (!result) {
+			delete r;
+			break;
+		}
+		SequenceRecord** slot = _records.get(key(r->created, r->textHash));
+		delete *slot;
+		*slot = r;
+	}
+	fclose(fp);
+	return result;
+}
+
+bool StageCache::write() {
+	timing::Timer t("StageCache::write");
+	FILE* fp = fopen(_filename.c_str(), "wb");
+	if (fp == null)
+		return false;
+	int version = STAGE_CACHE_VERSION;
+	int count = 0;
+	dictionary<SequenceRecord*>::iterator i = _records.begin();
+	while (i.valid()) {
+		if (*i)
+			count++;
+		i.next();
+	}
+	fwrite(stageCacheMagic, 1, sizeof stageCacheMagic, fp);
+	fwrite(&version, sizeof version, 1, fp);
+	fwrite(&count, sizeof count, 1, fp);
+	for (i = _records.begin(); i.valid(); i.next()) {
+		const SequenceRecord* r = *i;
+		if (r == null)
+			continue;
+		int definitions = r->definitions.size();
+		int variants = r->variants.size();
+		int stages = r->stages.size();
+		fwrite(&r->created, sizeof r->created, 1, fp);
+		fwrite(&r->textHash, sizeof r->textHash, 1, fp);
+		fwrite(&r->grammarHash, sizeof r->grammarHash, 1, fp);
+		fwrite(&r->dependencyHash, sizeof r->dependencyHash, 1, fp);
+		fwrite(&r->status, sizeof r->status, 1, fp);
+		fwrite(&definitions, sizeof definitions, 1, fp);
+		for (int j = 0; j < definitions; j++)
+			writeBinaryString(fp, r->definitions[j]);
+		fwrite(&variants, sizeof variants, 1, fp);
+		for (int j = 0; j < variants; j++)
+			writeBinaryString(fp, r->variants[j]);
+		fwrite(&stages, sizeof stages, 1, fp);
+		for (int j = 0; j < stages; j++) {
+			const StageRecord& sr = r->stages[j];
+			char failed = sr.failed;
+
+			fwrite(&sr.duration, sizeof sr.duration, 1, fp);
+			fwrite(&failed, sizeof failed, 1, fp);
+		}
+	}
+	bool result = ferror(fp) == 0;
+	if (fclose(fp) != 0)
+		result = false;
+	if (result)
+		_modified = false;
+	return result;
+}
+
+void StageCache::record(Sequence* sequence, const Grammar* grammar) {
+	validate(grammar);
+	const vector<const Stage*>& stages = sequence->stages();
+	SequenceRecord* r = new SequenceRecord;
+	r->created = sequence->created;
+	r->textHash = sequence->textHash();
+	r->grammarHash = _grammarHash;
+	r->status = sequence->status;
+	r->stages.resize(stages.size());
+	for (int i = 0; i < stages.size(); i++) {
+		const Stage* stage = stages[i];
+		StageRecord& sr = r->stages[i];
+
+		sr.duration = stage->duration();
+		sr.failed = stage->failed();
+		const vector<const Definition*>& used = stage->definitionsUsed();
+		for (int j = 0; j < used.size(); j++) {
+			const string& label = used[j]->label();
+			int k;
+			for (k = 0; k < r->definitions.size(); k++)
+				if (r->definitions[k] == label)
+					break;
+			if (k == r->definitions.size())
+				r->definitions.push_back(label);
+		}
+		const vector<VariantTile>& applied = stage->variantsApplied();
+		for (int j = 0; j < applied.size(); j++)
+			r->variants.push_back(VariantCoverage::key(applied[j].variant, applied[j].pattern));
+	}
+	r->dependencyHash = dependencyHash(r->definitions);
+	SequenceRecord** slot = _records.get(key(r->created, r->textHash));
+	delete *slot;
+	*slot = r;
+	_modified = true;
+}
+
+const SequenceRecord* StageCache::lookup(const Sequence* sequence, const Grammar* grammar) {
+	const SequenceRecord* r = *_records.get(key(sequence->created, sequence->textHash()));
+	if (r == null)
+		return null;
+	validate(grammar);
+	if (r->grammarHash != _grammarHash ||
+		r->dependencyHash != dependencyHash(r->definitions))
+		return null;
+	return r;
+}
+/*
+ *	validate
+ *
+ *	Brings the grammar hash and definition hashes up to date with the grammar,
+ *	including its backup grammar.
+ */
+void StageCache::validate(const Grammar* grammar) {
+	if (grammar == _grammar && !(grammar->lastChanged() > _grammarVersion))
+		return;
+	timing::Timer t("StageCache::validate");
+	_grammar = grammar;
+	_grammarVersion = grammar->lastChanged();
+	_definitionHashes.clear();
+	unsigned __int64 hash = HASH_BASIS;
+	for (const Grammar* g = grammar; g; g = g->backupGrammar()) {
+		const vector<Definition*>& definitions = g->definitions();
+		for (int i = 0; i < definitions.size(); i++) {
+			const Definition* d = definitions[i];
+			const vector<string>& productions = d->productions();
+			for (int j = 0; j < productions.size(); j++)
+				hash = hashString(hash, productions[j]);
+			unsigned __int64* definitionHash = _definitionHashes.get(d->label());
+			*definitionHash = *definitionHash * 31 + hashDefinition(d);
+		}
+		const vector<Formation*>& formations = g->formations();
+		for (int i = 0; i < formations.size(); i++) {
+			time_t modified = formations[i]->modified();
+			hash = hashString(hash, formations[i]->name());
+			hash = hashBytes(hash, &modified, sizeof modified);
+		}
+		const vector<Designator*>& designators = g->designators();
+		for (int i = 0; i < designators.size(); i++) {
+			const vector<string>& phrases = designators[i]->phrases();
+			hash = hashString(hash, designators[i]->label());
+			for (int j = 0; j < phrases.size(); j++)
+				hash = hashString(hash, phrases[j]);
+			hash = hashString(hash, designators[i]->expression());
+		}
+		const vector<Synonym*>& synonyms = g->synonyms();
+		for (int i = 0; i < synonyms.size(); i++) {
+			hash = hashString(hash, synonyms[i]->synonym());
+			hash = hashString(hash, synonyms[i]->value());
+		}
+	}
+	_grammarHash = hash;
+}
+
+unsigned __int64 StageCache::dependencyHash(const vector<string>& definitions) {
+	unsigned __int64 hash = HASH_BASIS;
+	for (int i = 0; i < definitions.size(); i++) {
+		unsigned __int64 definitionHash = *_definitionHashes.get(definitions[i]);
+		hash = hashString(hash, definitions[i]);
+		hash = hashBytes(hash, &definitionHash, sizeof definitionHash);
+	}
+	return hash;
+}
+
+unsigned __int64 StageCache::textHash(Level level, const vector<string>& text) {
+	unsigned __int64 hash = hashString(HASH_BASIS, levels[level]);
+	for (int i = 0; i < text.size(); i++)
+		hash = hashString(hash, text[i]);
+	return hash;
+}
+
+string StageCache::key(__int64 created, unsigned __int64 textHash) {
+	string s;
+
+	s.printf("%I64d:%I64x", created, textHash);
+	return s;
+}
+/*
+ *	FNV-1a, with each string followed by a 0 so that adjacent strings can't run together.
+ */
+static unsigned __int64 hashBytes(unsigned __int64 hash, const void* data, int length) {
+	const unsigned char* p = (const unsigned char*)data;
+	for (int i = 0; i < length; i++) {
+		hash ^= p[i];
+		hash *= HASH_PRIME;
+	}
+	return hash;
+}
+
+static unsigned __int64 hashString(unsigned __int64 hash, const string& s) {
+	return hashBytes(hash, s.c_str(), s.size() + 1);
+}
+/*
+ *	Everything a definition file says about the definition that can change how it is
+ *	performed: its level, productions, and the patterns, parts and actions of each
+ *	variant.
+ */
+static unsigned __int64 hashDefinition(const Definition* d) {
+	unsigned __int64 hash = hashString(HASH_BASIS, d->levelName());
+	const vector<string>& productions = d->productions();
+	for (int i = 0; i < productions.size(); i++)
+		hash = hashString(hash, productions[i]);
+	const vector<Variant*>& variants = d->variants();
+	for (int i = 0; i < variants.size(); i++) {
+		const Variant* v = variants[i];
+		int precedence = v->precedence();
+		hash = hashString(hash, "|");
+		hash = hashString(hash, v->levelName());
+		hash = hashBytes(hash, &precedence, sizeof precedence);
+		const vector<string>& patterns = v->patterns();
+		for (int j = 0; j < patterns.size(); j++)
+			hash = hashString(hash, patterns[j]);
+		for (int j = 0; j < v->partCount(); j++) {
+			const Part* p = v->part(j);
+			hash = hashString(hash, "+");
+			hash = hashString(hash, p->repeat());
+			for (int k = 0; k < p->actions(); k++)
+				hash = hashString(hash, p->action(k)->text());
+		}
+	}
+	return hash;
+}
+
+}  // namespace dance
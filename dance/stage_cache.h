@@ -0,0 +1,96 @@
+#pragma once
+#include "dance.h"
+
+namespace dance {
+
+class Grammar;
+class Sequence;
+
+const int STAGE_CACHE_VERSION = 4;
+/*
+ *	StageRecord
+ *
+ *	What is kept of one stage: enough to show the sequence's status without
+ *	running the calls again.
+ */
+class StageRecord {
+public:
+	beats			duration;
+	bool			failed;
+};
+
+class SequenceRecord {
+public:
+	__int64				created;
+	unsigned __int64	textHash;			// the calls and level of the sequence
+	unsigned __int64	grammarHash;		// the grammar's productions, formations and designators
+	unsigned __int64	dependencyHash;		// the text of the definitions used
+	int					status;
+	vector<string>		definitions;		// labels of the definitions used, in any stage
+	vector<string>		variants;			// VariantCoverage keys, one per variant applied, in any stage
+	vector<StageRecord>	stages;
+};
+/*
+ *	StageCache
+ *
+ *	The results of evaluating the sequences of one dance file, kept in a sidecar file
+ *	next to it (the file name with .stages added).  Only what the status display
+ *	needs is kept: the status, and each stage's duration and whether it failed.  The
+ *	final positions are not, so anything that shows the dancers performs the
+ *	sequence again.
+ *
+ *	A record is good for as long as the sequence text is unchanged, the grammar has the
+ *	same productions, formations and designators, and none of the definitions the
+ *	sequence used has had its text changed.  So editing one definition only sends the
+ *	sequences that use it back to be evaluated.
+ */
+class StageCache {
+public:
+	StageCache(const string& filename);
+
+	~StageCache();
+
+	bool read();
+
+	bool write();
+	/*
+	 *	record
+	 *
+	 *	Saves the results of the sequence's current stages.
+	 */
+	void record(Sequence* sequence, const Grammar* grammar);
+	/*
+	 *	lookup
+	 *
+	 *	Returns the saved results for the sequence if they are still valid against
+	 *	the grammar, else null.
+	 */
+	const SequenceRecord* lookup(const Sequence* sequence, const Grammar* grammar);
+
+	bool modified() const { return _modified; }
+	/*
+	 *	textHash
+	 *
+	 *	Hashes the calls and level of a sequence.  Sequence::textHash keeps the
+	 *	result, and the dance index saves it, so finding a record does not read
+	 *	the calls of a sequence from the dance file.
+	 */
+	static unsigned __int64 textHash(Level level, const vector<string>& text);
+
+private:
+	void validate(const Grammar* grammar);
+
+	unsigned __int64 dependencyHash(const vector<string>& definitions);
+
+	static string key(__int64 created, unsigned __int64 textHash);
+
+	string							_filename;
+	dictionary<SequenceRecord*>		_records;
+	bool							_modified;
+	const Grammar*					_grammar;			// the grammar the hashes below were computed from
+	fileSystem::TimeStamp			_grammarVersion;
+	unsigned __int64				_grammarHash;
+	dictionary<unsigned __int64>	_definitionHashes;	// by definition label
+};
+
+}  // namespace dance
@@ -37,9 +37,11 @@ class Rectangle;
 class Sequence;
 class Spot;
 class Stage;
+class StageCache;
 class Step;
 class Synonym;
 class Term;
+class TermPool;
 class Token;
 class Variant;
 class VariantTile;
@@ -52,6 +54,10 @@ typedef int Level;			// 0 = undefined 1 = unspecified 2-N defined levels INT_MAX
 const int ERROR_LEVEL = 0;				// The 'level' string in the datafile was unrecognizable
 const int NO_LEVEL = 1;					// 'level' 1 is reserved for no level specified.
 
+const int DANCE_READ_BUFFER = 64 * 1024;	// Initial size of the Dance::read buffer, grown for longer lines
+const int DANCE_JOURNAL_FRACTION = 4;		// Rewrite a dance file once its journal passes 1/4 of the file's size
+const int DANCE_INDEX_VERSION = 2;
+
 typedef	int	beats;			// arbitrary measure of time used for call timing
 
 enum TileAction {
@@ -200,6 +206,7 @@ enum SequenceStatus {
 };
 
 class Dance {
+	friend Sequence;
 public:
 	Dance(const string& label, const string& filename);
 
@@ -215,7 +222,47 @@ public:
 	// Test API
 	bool runAll(bool allowUnresolved, const Grammar* grammar);
 
+	/*
+	 *	save
+	 *
+	 *	Rewrites the whole file and empties the journal.
+	 */
 	bool save();
+	/*
+	 *	saveChanges
+	 *
+	 *	Appends each sequence touched since the last save to the journal, the file name
+	 *	with .journal added.  read() replays the journal over the file.  Falls back to a
+	 *	full save when the file has never been written or the journal has grown too large.
+	 */
+	bool saveChanges();
+	/*
+	 *	compact
+	 *
+	 *	Folds any journal back into the file.  This writes the sequences as they
+	 *	are now, so it is only used when there are no unsaved edits.
+	 */
+	bool compact();
+
+	bool needsCompaction() const;
+
+	void touch(Sequence* sequence);
+	/*
+	 *	stageCache
+	 *
+	 *	The saved results of evaluating this dance's sequences, read on first use from
+	 *	the file name with .stages added.  Null if the dance has no file name.
+	 */
+	StageCache* stageCache();
+
+	bool saveStageCache();
+	/*
+	 *	disableStageCache
+	 *
+	 *	From now on stageCache() returns null, so sequences are always performed and
+	 *	nothing is read from or written to the sidecar file.
+	 */
+	void disableStageCache();
 
 	void print();
 
@@ -230,6 +277,36 @@ public:
 	const vector<PlayList*>& playLists() const { return _playLists; }
 
 private:
+	/*
+	 *	readRecord
+	 *
+	 *	Applies one line of a .dnc file, text through end (which holds the terminating
+	 *	null).  Prints the file name and line number and returns false on a bad record.
+	 */
+	bool readRecord(const string& filename, char* text, char* end, int line, Sequence** sequence);
+
+	bool readFile(const string& filename, __int64* bytes);
+	/*
+	 *	readIndex
+	 *
+	 *	Creates the sequences from the index written by the last full save, the file
+	 *	name with .index added, leaving their calls unread.  Returns false, having
+	 *	created nothing, if there is no index or the file has changed since it was written.
+	 */
+	bool readIndex();
+
+	bool writeIndex(const vector<__int64>& offsets, const vector<int>& lengths) const;
+	/*
+	 *	readCalls
+	 *
+	 *	Reads the calls and notes of one sequence from the dance file.
+	 */
+	bool readCalls(__int64 offset, int length, vector<string>* text, vector<string>* notes) const;
+
+	string indexFilename() const;
+
+	string journalFilename() const;
+
 	string _levelName;
 	Level _level;
 	DanceType _danceType;
@@ -237,6 +314,12 @@ private:
 	vector<PlayList*> _playLists;
 	string _filename;
 	string _label;
+	__int64 _fileBytes;				// size of the file when last read or written
+	__int64 _journalBytes;			// size of the journal, 0 if there is none
+	int _changedCount;				// sequences touched since the last save
+	int _replaceAt;					// set by a journal '@' record: the next sequence replaces this one
+	StageCache* _stageCache;
+	bool _stageCacheDisabled;
 };
 
 class PlayList : public Dance {
@@ -308,6 +391,27 @@ public:
 	void append(const string& text);
 
 	void appendNotes(const string& text);
+	/*
+	 *	setLocation
+	 *
+	 *	Marks a sequence created from a dance index: only the summary fields are set,
+	 *	and the calls and notes are read from the dance file, length bytes at offset,
+	 *	the first time they are needed.
+	 */
+	void setLocation(__int64 offset, int length);
+
+	void load() const;
+	/*
+	 *	textHash
+	 *
+	 *	Returns the StageCache hash of the calls and level.  A sequence read from a
+	 *	dance index has the hash saved there, so this does not load its calls.
+	 */
+	unsigned __int64 textHash() const;
+
+	void setTextHash(unsigned __int64 hash);
+
+	bool loaded() const { return _loaded; }
 	// Test API
 	bool run(bool allowUnresolved, const Grammar* grammar);
 
@@ -318,6 +422,13 @@ public:
 	bool updateStatus(const Grammar* grammar);
 
 	const vector<const Stage*>& stages() { return _stages; }
+	/*
+	 *	expandStage
+	 *
+	 *	Returns the stage at index with its full plan tree, replaying it if the stage
+	 *	was pruned under leanStages.
+	 */
+	const Stage* expandStage(int index, const Grammar* grammar);
 
 	void clearStages();
 
@@ -333,9 +444,9 @@ public:
 
 	bool resolved() const;
 
-	const vector<string>& text() const { return _text; }
+	const vector<string>& text() const { load(); return _text; }
 
-	const vector<string>& notes() const { return _notes; }
+	const vector<string>& notes() const { load(); return _notes; }
 
 	fileSystem::TimeStamp lastChecked() const { return _lastChecked; }
 
@@ -345,14 +456,24 @@ public:
 
 	DanceType danceType() const { return _danceType; }
 
+	bool changed() const { return _changed; }
+
+	void setChanged(bool changed) { _changed = changed; }
+
 private:
 	Dance* _dance;
 	fileSystem::TimeStamp _lastChecked;
-	vector<string>	_text;
-	vector<string> _notes;
+	mutable vector<string>	_text;			// filled in by load() for a sequence read from an index
+	mutable vector<string> _notes;
 	vector<const Stage*> _stages;
 	Level			_level;
 	DanceType		_danceType;
+	bool			_changed;		// not yet written to the dance file or its journal
+	mutable bool	_loaded;		// false until the calls of an indexed sequence are read
+	mutable bool	_hashed;		// _textHash is good for the current calls and level
+	mutable unsigned __int64 _textHash;
+	__int64			_offset;
+	int				_length;
 };
 
 class VariantTile {
@@ -378,6 +499,38 @@ public:
 	bool		printed;		
 };
 
+/*
+ *	BreathingSolutions
+ *
+ *	The plane solutions Group::breathe has found, by the layout of the tile boxes
+ *	they were found for.  Each grammar owns one, so nothing is shared by the
+ *	calls performed under different grammars.  It is emptied when it reaches
+ *	MAX_BREATHING_SOLUTIONS layouts.
+ */
+class BreathingSolutions {
+public:
+	BreathingSolutions();
+
+	~BreathingSolutions();
+	/*
+	 *	find
+	 *
+	 *	Returns the (deltaX, deltaY) pairs, one per tile, remembered for the layout, or
+	 *	null if there are none.
+	 */
+	const vector<int>* find(const string& layout);
+
+	void remember(const string& layout, const vector<int>& deltaX, const vector<int>& deltaY);
+
+	void clear();
+
+	int size() const { return _count; }
+
+private:
+	dictionary<vector<int>*>	_solutions;		// tile box layout -> (deltaX, deltaY) per tile
+	int							_count;
+};
+
 class Grammar {
 	friend GrammarObject;
 	friend ParseObject;
@@ -424,6 +577,26 @@ public:
 	bool parsePartial(TokenType goalSymbol, const string& text, Level level, vector<string>* output) const;
 
 	const Anything* parse(const Group* dancers, const string& text, bool inDefinition, const Anything* call, Context* context, const Plan* variantPlan) const;
+	/*
+	 *	tokenizeCall
+	 *
+	 *	The first half of parse: splits the text of a call into tokens, with no
+	 *	dancers, call variables or variant plan.  Returns false if a word is not
+	 *	recognized.
+	 */
+	bool tokenizeCall(const string& text, Context* context, vector<Token>* tokens) const;
+	/*
+	 *	compileAction
+	 *
+	 *	Parses the text of a definition action once, independent of any dancers,
+	 *	call variables or variant locals.  The resulting term lives in term storage,
+	 *	so it remains valid until the next touch.
+	 *
+	 *	RETURNS:
+	 *		null if the text could not be parsed without a context, in which case the
+	 *		action must be parsed each time it is constructed.
+	 */
+	const Anything* compileAction(const string& text) const;
 
 	const Anyone* parseAnyone(const Group* dancers, const string& text, const Anything* call, Context* context, const Plan* variantPlan, const Term** local) const;
 
@@ -447,6 +620,8 @@ public:
 
 	void setBackupGrammar(Grammar* g);
 
+	const Grammar* backupGrammar() const { return _backupGrammar; }
+
 	const Term* lookup(const string& key) const { return *_words.get(key); }
 
 	bool error() const { return _error; }
@@ -462,6 +637,16 @@ public:
 	const vector<VariantTile>& couples() const;
 
 	fileSystem::TimeStamp lastChanged() const;
+	/*
+	 *	version
+	 *
+	 *	Changes with every touch of this grammar, including those fired by a change
+	 *	to its backup.  Unlike lastChanged, two touches within one clock tick still
+	 *	give different versions.  Versions come from one counter shared by every
+	 *	grammar, so no two grammars, even one created where another was deleted,
+	 *	ever have the same version.
+	 */
+	int version() const { return _version; }
 
 	const vector<Synonym*>& synonyms() const { return _synonyms; }
 
@@ -475,6 +660,14 @@ public:
 
 	Stage* termStorage() const { return _termStorage; }
 
+	const TermPool* termPool() const { return _termPool; }
+	/*
+	 *	breathingSolutions
+	 *
+	 *	What Group::breathe remembers for the calls performed under this grammar.
+	 */
+	BreathingSolutions* breathingSolutions() const { return &_breathingSolutions; }
+
 	Event			changed;
 
 private:
@@ -530,6 +723,7 @@ private:
 	int matchPrimitiveParameters(Anything* instance, const vector<Token>& tokens, int tIndex, Context* context) const;
 
 	fileSystem::TimeStamp _lastChanged;
+	int _version;					// renewed by the constructor and touch
 	DanceType _danceType;
 	mutable dictionary<const Term*>	_words;
 	vector<Synonym*> _synonyms;
@@ -541,6 +735,7 @@ private:
 	dictionary<Formation*> _formationDictionary;
 
 	mutable Pattern* _couple;
+	mutable BreathingSolutions _breathingSolutions;
 	mutable vector<VariantTile> _leadersTrailers;
 	mutable vector<VariantTile> _partners;
 	mutable vector<VariantTile> _couples;
@@ -557,6 +752,7 @@ private:
 
 	string _filename;
 	Stage* _termStorage;			// allocator for definition productions
+	TermPool* _termPool;			// shared immutable terms, lives as long as the grammar
 };
 
 const int NULL_STATE = -1;
@@ -825,6 +1021,13 @@ public:
 	virtual void write(FILE* fp) const = 0;
 
 	virtual void print(int indent) const = 0;
+	/*
+	 *	text
+	 *
+	 *	The action as it is written in the definition, so that two actions with the
+	 *	same text do the same thing.
+	 */
+	virtual string text() const = 0;
 
 	Part* parent() const { return _parent; }
 
@@ -836,9 +1039,14 @@ class SimpleAction : public Action {
 public:
 	SimpleAction(Part* parent, const string& text) : Action(parent) {
 		_action = text;
+		_compiledVersion = 0;
+		_compiled = null;
 	}
 
-	void set_action(const string& text) { _action = text; }
+	void set_action(const string& text) {
+		_action = text;
+		_compiledVersion = 0;
+	}
 
 	virtual Step* construct(PartStep* step, Context* context, TileAction tileAction) const;
 
@@ -848,10 +1056,22 @@ public:
 
 	virtual void print(int indent) const;
 
+	virtual string text() const;
+
 	const string& action() const { return _action; }
 
 private:
+	/*
+	 *	compiled
+	 *
+	 *	Returns the context-free parse of the action text, compiling it the first time
+	 *	it is needed after any change to the grammar.
+	 */
+	const Anything* compiled(const Grammar* grammar) const;
+
 	string			_action;
+	mutable int					_compiledVersion;	// the grammar's version when compiled, 0 if never
+	mutable const Anything*		_compiled;			// null if the text depends on its context
 };
 
 class Track {
@@ -896,6 +1116,8 @@ public:
 
 	virtual void print(int indent) const;
 
+	virtual string text() const;
+
 	const vector<Track*>& tracks() const { return _tracks; }
 
 private: